@@ -0,0 +1,804 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sync.h"
+#include "actors.h"
+
+// The code below was the body of cmain() in cook.c, wmain() in waiter.c,
+// cmain() and main() in customer.c and the supervisors in cook.c and
+// waiter.c, cut at every wait and sleep. Each state is the point where a
+// step resumes.
+
+enum { COOK_START, COOK_WAIT, COOK_WOKEN, COOK_COOKED };
+enum { WAITER_START, WAITER_LOOP, WAITER_WOKEN, WAITER_WORK, WAITER_ORDER_TAKEN, WAITER_PUSH };
+enum { CUSTOMER_ARRIVE, CUSTOMER_ORDERED, CUSTOMER_SERVED, CUSTOMER_EATEN };
+enum { DOOR_NEXT, DOOR_ARRIVED, DOOR_CLOSED };
+enum { SUPERVISOR_START, SUPERVISOR_OPENED, SUPERVISOR_TICK };
+
+static struct act act_wait(int sem_num) {
+    return (struct act){ACT_WAIT, sem_num, 0, 0};
+}
+
+static struct act act_sleep(int until, int minutes) {
+    return (struct act){ACT_SLEEP, 0, until, minutes};
+}
+
+static struct act act_done(void) {
+    return (struct act){ACT_DONE, 0, 0, 0};
+}
+
+// Semaphore operations through the actor's ops
+static int env_wait(const struct actor_env *env, int sem_num) {
+    return env->ops->wait(env->semid, sem_num);
+}
+
+static int env_trywait(const struct actor_env *env, int sem_num) {
+    return env->ops->trywait(env->semid, sem_num);
+}
+
+static int env_signal(const struct actor_env *env, int sem_num) {
+    return env->ops->signal(env->semid, sem_num);
+}
+
+static int env_signal_many(const struct actor_env *env, const int *sem_nums, int n) {
+    return env->ops->signal_many(env->semid, sem_nums, n);
+}
+
+int act_perform(const struct actor_env *env, struct act act) {
+    if (act.kind == ACT_WAIT) return env_wait(env, act.sem);
+    if (act.kind == ACT_SLEEP) return sync_sleep(env->semid, act.until, act.minutes * TIME_SCALE);
+    return 0;
+}
+
+void restaurant_open(const struct actor_env *env) {
+    __atomic_store_n(&env->shm->open, 1, __ATOMIC_RELEASE);
+    if (config.max_cooks > config.cooks) env_signal(env, OPENED(0));
+    if (config.max_waiters > config.waiters) env_signal(env, OPENED(1));
+}
+
+// Cook
+
+void cook_init(struct cook *cook, const struct actor_env *env, int cook_id) {
+    *cook = (struct cook){.env = *env, .id = cook_id, .state = COOK_START};
+    cook->batch = malloc(config.batch_orders * sizeof(struct cook_order));
+    if (cook->batch == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+}
+
+void cook_leaving(struct cook *cook) {
+    log_put(LOG_COOK_LEAVING, cook->last_time, cook->last_cook_id, 0, cook->last_time_cook == cook->last_time, 0);
+}
+
+static struct act cook_done(struct cook *cook) {
+    free(cook->batch);
+    cook->batch = NULL;
+    COOK_STATS(cook->env.shm, cook->id)->on_duty = 0;
+    return act_done();
+}
+
+struct act cook_step(struct cook *cook) {
+    const struct actor_env *env = &cook->env;
+    struct restaurant_shm *shm = env->shm;
+    struct cook_order *batch = cook->batch;
+    int cook_id = cook->id;
+    while (1) {
+        switch (cook->state) {
+        case COOK_START:
+            // Print cook is ready
+            log_put(LOG_COOK_READY, clock_now(shm), cook_id, 0, 0, 0);
+            __atomic_fetch_add(&shm->ready, 1, __ATOMIC_RELEASE);
+            cook->state = COOK_WAIT;
+            break;
+
+        case COOK_WAIT:
+            // Wait until woken up by a waiter
+            cook->state = COOK_WOKEN;
+            return act_wait(COOK_SEM);
+
+        case COOK_WOKEN: {
+            // Take a batch of cooking requests from the queue: up to
+            // batch_orders orders, and no more than batch_persons persons
+            // unless the first order alone is bigger. The wake-up pays for
+            // the first order; each further one takes its own, so that no
+            // other cook is woken for it. If another cook was woken for it
+            // meanwhile, leave it.
+            env_wait(env, COOK_QUEUE_LOCK);
+            seq_write_begin(&shm->cook_queue.seq);
+            int pending_orders = shm->cook_queue.pending;
+            int cooking = shm->cook_queue.cooking;
+            int batch_size = 0;
+            int persons = 0;
+            int sent_home = 0;
+            if (shm->cook_queue.retire > 0 && pending_orders == 0) {
+                // The supervisor has too many cooks and nothing is waiting
+                shm->cook_queue.retire--;
+                sent_home = 1;
+            }
+            struct cook_order next;
+            while (!sent_home && batch_size < config.batch_orders && cook_queue_peek(shm, &next) == 0 &&
+                   (batch_size == 0 || config.batch_persons == 0 ||
+                    persons + next.count <= config.batch_persons) &&
+                   (batch_size == 0 || env_trywait(env, COOK_SEM) == 0)) {
+                cook_queue_pop(shm, &batch[batch_size++]);
+                persons += next.count;
+            }
+            shm->cook_queue.cooking += batch_size;
+            seq_write_end(&shm->cook_queue.seq);
+            env_signal(env, COOK_QUEUE_LOCK);
+            stats_cook_wakeup(shm, batch_size == 0 && !sent_home);
+
+            if (sent_home) {
+                log_put(LOG_COOK_SENT_HOME, clock_now(shm), cook_id, 0, 0, 0);
+                return cook_done(cook);
+            }
+
+            // Check if it's after 3:00pm and the cooking queue is empty,
+            // and that no other cook still has food to hand out.
+            int curr_time = clock_now(shm);
+            if (curr_time > 240 && pending_orders == 0 && cooking == 0) {  // 240 mins = 4 hours after 11am = 3pm
+                // Wake up all waiters
+                int *all = malloc(config.max_waiters * sizeof(int));
+                if (all == NULL) {
+                    perror("malloc");
+                    exit(1);
+                }
+                for (int i = 0; i < config.max_waiters; i++) {
+                    all[i] = WAITER_SEM(i);
+                }
+                env_signal_many(env, all, config.max_waiters);
+                free(all);
+                return cook_done(cook);
+            }
+
+            // If there are no pending orders, continue waiting
+            if (batch_size == 0) {
+                cook->state = COOK_WAIT;
+                break;
+            }
+
+            // Print starting order preparation
+            for (int i = 0; i < batch_size; i++) {
+                stats_order_taken(shm, curr_time - batch[i].enqueue_time);
+                SLOT_COOKED(shm)[batch[i].slot] = curr_time;
+                log_put(LOG_COOK_PREPARING, curr_time, cook_id, batch[i].customer_id,
+                        batch[i].waiter_id, batch[i].count);
+            }
+
+            // Cook prepares the whole batch at once (5 minutes per person by default)
+            cook->batch_size = batch_size;
+            cook->persons = persons;
+            cook->curr_time = curr_time;
+            cook->cook_time = cooking_time(persons);
+            cook->state = COOK_COOKED;
+            return act_sleep(curr_time + cook->cook_time, cook->cook_time);
+        }
+
+        case COOK_COOKED: {
+            int curr_time = cook->curr_time;
+            int cook_time = cook->cook_time;
+            int batch_size = cook->batch_size;
+            stats_batch_done(shm, cook_id, batch_size, cook_time, curr_time + cook_time);
+
+            for (int i = 0; i < batch_size; i++) {
+                int waiter_id = batch[i].waiter_id;
+
+                // Update the time after cooking, before the food is handed
+                // over, so that it cannot be served before it was prepared
+                int new_time = clock_advance(shm, curr_time + cook_time);
+                cook->last_cook_id = cook_id;
+                cook->last_time_cook = new_time;
+                log_put(LOG_COOK_PREPARED, new_time, cook_id, batch[i].customer_id, waiter_id, batch[i].count);
+                if (new_time > cook->last_time) {
+                    cook->last_time = new_time;
+                }
+
+                // Notify the waiter that food is ready: put the customer's
+                // slot on its food-ready ring and signal it, see the
+                // semaphores in restaurant.h
+                struct waiter_area *area = WAITER_AREA(shm, waiter_id);
+                env_wait(env, WAITER_QUEUE_LOCK(waiter_id));
+                seq_write_begin(&area->seq);
+                food_push(area, batch[i].slot);
+                seq_write_end(&area->seq);
+                env_signal_many(env, (int[]){WAITER_SEM(waiter_id), WAITER_QUEUE_LOCK(waiter_id)}, 2);
+            }
+            env_wait(env, COOK_QUEUE_LOCK);
+            seq_write_begin(&shm->cook_queue.seq);
+            shm->cook_queue.cooking -= batch_size;
+            seq_write_end(&shm->cook_queue.seq);
+            env_signal(env, COOK_QUEUE_LOCK);
+            cook->state = COOK_WAIT;
+            break;
+        }
+        }
+    }
+}
+
+// Waiter
+
+void waiter_init(struct waiter *waiter, const struct actor_env *env, int waiter_id) {
+    *waiter = (struct waiter){.env = *env, .id = waiter_id, .state = WAITER_START, .food_slot = -1};
+}
+
+void waiter_leaving(struct waiter *waiter, int woken) {
+    log_put(LOG_WAITER_LEAVING, -1, waiter->id, 0, woken, 0);
+}
+
+// Keep the longest wait to order for the supervisor. The caller holds the
+// queue's lock and has just taken the customer from it.
+static void note_order_wait(struct restaurant_shm *shm, struct waiter_area *area,
+                            const struct waiting_customer *customer) {
+    int wait = clock_now(shm) - customer->queue_time;
+    if (wait > area->longest_wait) area->longest_wait = wait;
+}
+
+// Work stealing: if this waiter has nothing of its own to do, take the
+// oldest customer queued for the waiter with the most customers waiting,
+// together with the victim's wake-up for it. The victim has at least
+// STEAL_MIN customers queued, so at most one of their wake-ups can be on
+// its way to the victim and the semaphore still holds another. Returns 1
+// with a customer.
+static int waiter_steal(struct waiter *waiter, struct waiting_customer *customer) {
+    const struct actor_env *env = &waiter->env;
+    struct restaurant_shm *shm = env->shm;
+    int waiter_id = waiter->id;
+    struct waiter_area *area = WAITER_AREA(shm, waiter_id);
+    env_wait(env, WAITER_QUEUE_LOCK(waiter_id));
+    int idle = (food_ready(area) == 0 && area->po == 0 && !area->retire);
+    env_signal(env, WAITER_QUEUE_LOCK(waiter_id));
+    if (!idle) return 0;
+
+    // Pick the victim without its lock, then check again under it
+    int victim = -1;
+    int most = STEAL_MIN - 1;
+    for (int i = 0; i < config.max_waiters; i++) {
+        int po = __atomic_load_n(&WAITER_AREA(shm, i)->po, __ATOMIC_RELAXED);
+        if (i != waiter_id && po > most) {
+            victim = i;
+            most = po;
+        }
+    }
+    if (victim == -1) return 0;
+
+    struct waiter_area *victim_area = WAITER_AREA(shm, victim);
+    int stolen = 0;
+    env_wait(env, WAITER_QUEUE_LOCK(victim));
+    if (victim_area->po >= STEAL_MIN && env_trywait(env, WAITER_SEM(victim)) == 0) {
+        seq_write_begin(&victim_area->seq);
+        stolen = (waiter_queue_pop(victim_area, customer) == 0);
+        if (stolen) note_order_wait(shm, victim_area, customer);
+        seq_write_end(&victim_area->seq);
+    }
+    env_signal(env, WAITER_QUEUE_LOCK(victim));
+    if (stolen) stats_customer_stolen(shm, waiter_id);
+    return stolen;
+}
+
+static struct act waiter_done(struct waiter *waiter) {
+    struct restaurant_shm *shm = waiter->env.shm;
+    if (!waiter->sent_home) log_put(LOG_WAITER_SHIFT_ENDED, clock_now(shm), waiter->id, 0, 0, 0);
+    WAITER_STATS(shm, waiter->id)->on_duty = 0;
+    return act_done();
+}
+
+struct act waiter_step(struct waiter *waiter) {
+    const struct actor_env *env = &waiter->env;
+    struct restaurant_shm *shm = env->shm;
+    int waiter_id = waiter->id;
+    struct waiter_area *area = WAITER_AREA(shm, waiter_id);
+    while (1) {
+        switch (waiter->state) {
+        case WAITER_START:
+            // Print waiter is ready
+            log_put(LOG_WAITER_READY, clock_now(shm), waiter_id, 0, 0, 0);
+            __atomic_fetch_add(&shm->ready, 1, __ATOMIC_RELEASE);
+            waiter->state = WAITER_LOOP;
+            break;
+
+        case WAITER_LOOP:
+            // Sent home by the supervisor: go once every customer given to
+            // this waiter has been served. No new ones are given to it
+            // meanwhile.
+            if (__atomic_load_n(&area->retire, __ATOMIC_RELAXED)) {
+                env_wait(env, WAITER_QUEUE_LOCK(waiter_id));
+                waiter->sent_home = (food_ready(area) == 0 && area->po == 0 && waiter->outstanding == 0 &&
+                                     !area->steal_hint &&
+                                     __atomic_load_n(&area->incoming, __ATOMIC_ACQUIRE) == 0);
+                env_signal(env, WAITER_QUEUE_LOCK(waiter_id));
+                if (waiter->sent_home) {
+                    log_put(LOG_WAITER_SENT_HOME, clock_now(shm), waiter_id, 0, 0, 0);
+                    return waiter_done(waiter);
+                }
+            }
+
+            waiter->food_slot = -1;
+            waiter->have_customer = 0;
+            waiter->ticket = 0;
+            if (config.steal && waiter_steal(waiter, &waiter->customer)) {
+                waiter->have_customer = 1;
+                __atomic_store_n(&area->busy, 1, __ATOMIC_RELAXED);
+                waiter->state = WAITER_WORK;
+                break;
+            }
+            // Wait until woken up by a cook or a customer
+            waiter->state = WAITER_WOKEN;
+            return act_wait(WAITER_SEM(waiter_id));
+
+        case WAITER_WOKEN:
+            // Take one item of work: food that is ready comes first, then new customers
+            env_wait(env, WAITER_QUEUE_LOCK(waiter_id));
+            seq_write_begin(&area->seq);
+            if (food_pop(area, &waiter->food_slot) == 0) {
+                // Serve it below
+            } else if (area->po > 0) {
+                waiter->have_customer = (waiter_queue_pop(area, &waiter->customer) == 0);
+                if (waiter->have_customer) note_order_wait(shm, area, &waiter->customer);
+            } else if (area->retire == 1) {
+                // The supervisor's send-home, acted on at the top of the loop
+                area->retire = 2;
+                waiter->ticket = 1;
+            } else if (area->steal_hint) {
+                // A customer's hint that another waiter has a queue to
+                // steal from, which the top of the loop tries
+                area->steal_hint = 0;
+                waiter->ticket = 1;
+            }
+            __atomic_store_n(&area->busy, waiter->food_slot != -1 || waiter->have_customer, __ATOMIC_RELAXED);
+            seq_write_end(&area->seq);
+            env_signal(env, WAITER_QUEUE_LOCK(waiter_id));
+            stats_waiter_wakeup(shm, waiter->food_slot == -1 && !waiter->have_customer && !waiter->ticket);
+            waiter->state = waiter->ticket ? WAITER_LOOP : WAITER_WORK;
+            break;
+
+        case WAITER_WORK: {
+            int curr_time = clock_now(shm);
+            waiter->curr_time = curr_time;
+
+            // Check if it's after 3:00pm and no more customers
+            if (curr_time > 240 && waiter->food_slot == -1 && !waiter->have_customer) {
+                log_put(LOG_WAITER_SHIFT_ENDING, curr_time, waiter_id, 0, 0, 0);
+                return waiter_done(waiter);
+            }
+
+            // Food from the cooks
+            if (waiter->food_slot != -1) {
+                // The slot stays leased to the customer until they have eaten
+                int slot = waiter->food_slot;
+                log_put(LOG_WAITER_SERVING, curr_time, waiter_id, SLOT_OWNER(shm)[slot], 0, 0);
+                stats_waiter_served(shm, waiter_id);
+
+                // Signal the customer that food is ready
+                waiter->outstanding--;
+                env_signal(env, CUSTOMER_SEM(slot));
+            }
+            // A new customer to take the order from
+            else if (waiter->have_customer) {
+                // Take order from the customer (1 minute)
+                waiter->state = WAITER_ORDER_TAKEN;
+                return act_sleep(curr_time + 1, 1);
+            }
+            // Otherwise there was no work to do
+            __atomic_store_n(&area->busy, 0, __ATOMIC_RELAXED);
+            waiter->state = WAITER_LOOP;
+            break;
+        }
+
+        case WAITER_ORDER_TAKEN: {
+            struct waiting_customer *customer = &waiter->customer;
+
+            // Update time after taking order
+            int curr_time = clock_advance(shm, waiter->curr_time + 1);
+            log_put(LOG_WAITER_PLACED, curr_time, waiter_id, customer->customer_id, 0, 0);
+            stats_waiter_placed(shm, waiter_id);
+            waiter->order = (struct cook_order){waiter_id, customer->customer_id, customer->count,
+                                                customer->slot, curr_time};
+            waiter->retry_time = curr_time;
+            waiter->state = WAITER_PUSH;
+            break;
+        }
+
+        case WAITER_PUSH: {
+            // Add the order to the cooks' queue, backing off while it is full
+            struct cook_order *order = &waiter->order;
+            env_wait(env, COOK_QUEUE_LOCK);
+            seq_write_begin(&shm->cook_queue.seq);
+            if (cook_queue_push(shm, order) == -1) {
+                // Reported once per order, not on every pass
+                if (waiter->retry_time == order->enqueue_time) {
+                    fprintf(stderr, "Waiter %s: cook queue full (%d pending orders), retrying\n",
+                            waiter_name(waiter_id), shm->cook_queue.pending);
+                }
+                seq_write_end(&shm->cook_queue.seq);
+                env_signal(env, COOK_QUEUE_LOCK);
+                return act_sleep(++waiter->retry_time, 1);
+            }
+            seq_write_end(&shm->cook_queue.seq);
+            waiter->outstanding++;
+            SLOT_WAITER(shm)[order->slot] = waiter_id;
+
+            // Release the queue, signal a cook that a new order is available
+            // and the customer that the order has been placed, in one call
+            env_signal_many(env, (int[]){COOK_QUEUE_LOCK, COOK_SEM, CUSTOMER_SEM(order->slot)}, 3);
+            __atomic_store_n(&area->busy, 0, __ATOMIC_RELAXED);
+            waiter->state = WAITER_LOOP;
+            break;
+        }
+        }
+    }
+}
+
+// Customer
+
+void customer_init(struct customer *customer, const struct actor_env *env,
+                   const struct customer_record *record) {
+    *customer = (struct customer){.env = *env, .id = record->customer_id, .state = CUSTOMER_ARRIVE,
+                                  .arrival_time = record->arrival_time, .count = record->count};
+}
+
+struct act customer_step(struct customer *customer) {
+    const struct actor_env *env = &customer->env;
+    struct restaurant_shm *shm = env->shm;
+    int customer_id = customer->id;
+    switch (customer->state) {
+    case CUSTOMER_ARRIVE: {
+        // Check current time and set arrival time if needed
+        int curr_time = clock_advance(shm, customer->arrival_time);
+        customer->curr_time = curr_time;
+
+        // Check if it's after 3:00pm
+        if (curr_time > 240) {
+            log_put(LOG_CUSTOMER_LATE, curr_time, 0, customer_id, 0, 0);
+            stats_rejected(shm, REJECT_LATE);
+            return act_done();
+        }
+
+        // Take an empty table and pick the waiter to serve
+        env_wait(env, TABLE_LOCK);
+        int seated = (shm->tables.empty > 0);
+        int waiter_id = 0;
+        int slot = -1;
+        if (seated) {
+            // Use an empty table, and the wake-up slot that comes with it
+            seq_write_begin(&shm->tables.seq);
+            stats_tables(shm);
+            shm->tables.empty--;
+            slot = slot_lease(shm, customer_id);
+            waiter_id = waiter_pick(shm, customer_id);
+            seq_write_end(&shm->tables.seq);
+        }
+        env_signal(env, TABLE_LOCK);
+
+        // Check if any table is empty
+        if (!seated) {
+            log_put(LOG_CUSTOMER_NO_TABLE, curr_time, 0, customer_id, 0, 0);
+            stats_rejected(shm, REJECT_NO_TABLE);
+            return act_done();
+        }
+        customer->slot = slot;
+
+        struct waiter_area *area = WAITER_AREA(shm, waiter_id);
+
+        // Write to waiter's queue, and wake up the waiter while the customer
+        // is still there to be found (see the semaphores in restaurant.h)
+        struct waiting_customer waiting = {customer_id, customer->count, slot, curr_time};
+        env_wait(env, WAITER_QUEUE_LOCK(waiter_id));
+        seq_write_begin(&area->seq);
+        int queued = (waiter_queue_push(area, &waiting) == 0);
+        seq_write_end(&area->seq);
+        if (queued) {
+            env_signal_many(env, (int[]){WAITER_SEM(waiter_id), WAITER_QUEUE_LOCK(waiter_id)}, 2);
+        } else {
+            env_signal(env, WAITER_QUEUE_LOCK(waiter_id));
+        }
+        waiter_arrived(shm, waiter_id);
+
+        // A long queue: get an idle waiter to steal from it
+        int idle = queued ? waiter_hint(shm, waiter_id) : -1;
+        if (idle != -1) {
+            struct waiter_area *idle_area = WAITER_AREA(shm, idle);
+            env_wait(env, WAITER_QUEUE_LOCK(idle));
+            if (waiter_idle(idle_area)) {
+                seq_write_begin(&idle_area->seq);
+                idle_area->steal_hint = 1;
+                seq_write_end(&idle_area->seq);
+                env_signal_many(env, (int[]){WAITER_SEM(idle), WAITER_QUEUE_LOCK(idle)}, 2);
+            } else {
+                env_signal(env, WAITER_QUEUE_LOCK(idle));
+            }
+        }
+        if (!queued) {
+            // Give the table back
+            env_wait(env, TABLE_LOCK);
+            seq_write_begin(&shm->tables.seq);
+            slot_release(shm, slot);
+            stats_tables(shm);
+            shm->tables.empty++;
+            seq_write_end(&shm->tables.seq);
+            env_signal(env, TABLE_LOCK);
+            log_put(LOG_CUSTOMER_OVERLOADED, curr_time, 0, customer_id, waiter_id, 0);
+            stats_rejected(shm, REJECT_OVERLOADED);
+            return act_done();
+        }
+
+        log_put(LOG_CUSTOMER_ARRIVES, curr_time, 0, customer_id, 0, customer->count);
+
+        // Wait for the waiter to attend
+        customer->state = CUSTOMER_ORDERED;
+        return act_wait(CUSTOMER_SEM(slot));
+    }
+
+    case CUSTOMER_ORDERED: {
+        // Another waiter may have taken the order, see waiter_steal()
+        int tt = clock_now(shm);
+        log_put(LOG_CUSTOMER_ORDER_PLACED, tt, 0, customer_id, SLOT_WAITER(shm)[customer->slot], 0);
+        stats_order_placed(shm, tt - customer->curr_time);
+
+        // Wait for food to be served
+        customer->state = CUSTOMER_SERVED;
+        return act_wait(CUSTOMER_SEM(customer->slot));
+    }
+
+    case CUSTOMER_SERVED: {
+        // Food is served, start eating
+        int curr_time2 = clock_now(shm);
+        int waiting_time = curr_time2 - customer->curr_time;
+        customer->curr_time2 = curr_time2;
+        log_put(LOG_CUSTOMER_GETS_FOOD, curr_time2, 0, customer_id, 0, waiting_time);
+        stats_customer_served(shm, waiting_time, curr_time2 - SLOT_COOKED(shm)[customer->slot]);
+
+        // Eat for 30 minutes
+        customer->state = CUSTOMER_EATEN;
+        return act_sleep(curr_time2 + 30, 30);
+    }
+
+    case CUSTOMER_EATEN: {
+        // Free the table
+        env_wait(env, TABLE_LOCK);
+        seq_write_begin(&shm->tables.seq);
+        slot_release(shm, customer->slot);
+        stats_tables(shm);
+        int empty_tables = ++shm->tables.empty;
+        seq_write_end(&shm->tables.seq);
+        env_signal(env, TABLE_LOCK);
+
+        // Update time after eating
+        clock_advance(shm, customer->curr_time + 30);
+        log_put(LOG_CUSTOMER_FINISHED, customer->curr_time2 + 30, 0, customer_id, 0, empty_tables);
+        break;
+    }
+    }
+    return act_done();
+}
+
+// Door
+
+void door_init(struct door *door, const struct actor_env *env, struct custfile *customers) {
+    *door = (struct door){.env = *env, .customers = customers, .state = DOOR_NEXT};
+}
+
+struct act door_step(struct door *door) {
+    struct customer_record *record = &door->record;
+    while (1) {
+        switch (door->state) {
+        case DOOR_NEXT:
+            if (!custfile_next(door->customers, record)) {
+                if (door->list_done != NULL) door->list_done(door);
+                door->state = DOOR_CLOSED;
+                break;
+            }
+            // Wait for the time difference between consecutive customers
+            if (record->arrival_time > door->prev_arrival_time) {
+                door->state = DOOR_ARRIVED;
+                return act_sleep(record->arrival_time, record->arrival_time - door->prev_arrival_time);
+            }
+            door->prev_arrival_time = record->arrival_time;
+            door->admit(door, record);
+            break;
+
+        case DOOR_ARRIVED:
+            // Update the shared memory time
+            clock_advance(door->env.shm, record->arrival_time);
+            door->prev_arrival_time = record->arrival_time;
+            door->admit(door, record);
+            door->state = DOOR_NEXT;
+            break;
+
+        case DOOR_CLOSED:
+            // Wait for every customer to have left
+            if (door->finished == door->started) return act_done();
+            door->finished++;
+            return act_wait(CUSTOMER_DONE);
+        }
+    }
+}
+
+// Supervisors
+
+void supervisor_init(struct supervisor *sup, const struct actor_env *env, int pool, void (*hire)(int id)) {
+    *sup = (struct supervisor){.env = *env, .pool = pool, .state = SUPERVISOR_START,
+                               .on_duty = (pool == 0) ? config.cooks : config.waiters,
+                               .hire = hire};
+}
+
+// One period of the cook pool: call cooks in when orders back up and send
+// them home when idle. Returns 0 once the day is over, which it learns
+// from the semaphores being removed or from every cook having left, or
+// once closed with the kitchen done.
+static int supervise_cooks(struct supervisor *sup) {
+    const struct actor_env *env = &sup->env;
+    struct restaurant_shm *shm = env->shm;
+    int alive = 0;
+    for (int i = 0; i < config.max_cooks; i++) {
+        if (COOK_STATS(shm, i)->on_duty) alive++;
+    }
+    if (alive == 0) return 0;
+
+    if (env_wait(env, COOK_QUEUE_LOCK) == -1) return 0;
+    int pending = shm->cook_queue.pending;
+    int cooking = shm->cook_queue.cooking;
+    struct cook_order next;
+    int oldest_wait = (cook_queue_peek(shm, &next) == 0) ? clock_now(shm) - next.enqueue_time : 0;
+    int send_home = 0;
+    if (clock_now(shm) > 240 && pending == 0 && cooking == 0) {
+        // Closed and the kitchen is done: leave the pool as it is. In
+        // virtual time this also stops the periods running on alone.
+        env_signal(env, COOK_QUEUE_LOCK);
+        return 0;
+    }
+    if (pending == 0 && cooking < sup->on_duty) {
+        if (++sup->idle_periods >= IDLE_PERIODS && sup->on_duty > config.cooks) {
+            // The ticket, and a wake-up for an idle cook to take it
+            seq_write_begin(&shm->cook_queue.seq);
+            shm->cook_queue.retire++;
+            seq_write_end(&shm->cook_queue.seq);
+            sup->on_duty--;
+            send_home = 1;
+            sup->idle_periods = 0;
+        }
+    } else {
+        sup->idle_periods = 0;
+    }
+    if (send_home) {
+        env_signal_many(env, (int[]){COOK_SEM, COOK_QUEUE_LOCK}, 2);
+    } else {
+        env_signal(env, COOK_QUEUE_LOCK);
+    }
+
+    int hired = 0;
+    if (!send_home && (pending > SCALE_UP_BACKLOG * sup->on_duty || oldest_wait >= SCALE_UP_WAIT) &&
+        sup->on_duty < config.max_cooks) {
+        // A cook that was sent home may not have left yet
+        for (int i = 0; i < config.max_cooks; i++) {
+            if (!COOK_STATS(shm, i)->on_duty) {
+                sup->hire(i);
+                sup->on_duty++;
+                hired = 1;
+                break;
+            }
+        }
+    }
+    stats_pool(shm, hired, 0, alive * SUPERVISE_PERIOD, 0);
+    return 1;
+}
+
+// One period of the waiter pool. Waiters 0..active_waiters-1 take new
+// customers; the pool grows and shrinks at the top, and a waiter sent home
+// first finishes with its customers. Returns 0 once the day is over or the
+// restaurant has closed.
+static int supervise_waiters(struct supervisor *sup) {
+    const struct actor_env *env = &sup->env;
+    struct restaurant_shm *shm = env->shm;
+    int alive = 0;
+    for (int i = 0; i < config.max_waiters; i++) {
+        if (WAITER_STATS(shm, i)->on_duty) alive++;
+    }
+    if (alive == 0) return 0;
+
+    // Customers and plates waiting, and the longest anyone has waited to
+    // order this period, taken or still queued
+    int now = clock_now(shm);
+    int active = shm->tables.active_waiters;    // changed by this supervisor alone
+    int queued = 0;
+    int plates = 0;
+    int longest_wait = 0;
+    for (int i = 0; i < active; i++) {
+        struct waiter_area *area = WAITER_AREA(shm, i);
+        struct waiting_customer next;
+        if (env_wait(env, WAITER_QUEUE_LOCK(i)) == -1) return 0;
+        queued += area->po;
+        plates += food_ready(area);
+        if (waiter_queue_peek(area, &next) == 0 && now - next.queue_time > longest_wait) {
+            longest_wait = now - next.queue_time;
+        }
+        if (area->longest_wait > longest_wait) longest_wait = area->longest_wait;
+        area->longest_wait = 0;
+        env_signal(env, WAITER_QUEUE_LOCK(i));
+    }
+    int waiting = queued + plates;
+    if (now > 240 && waiting == 0) {
+        // Closed: leave the pool as it is, see supervise_cooks()
+        return 0;
+    }
+
+    int send_home = -1;
+    if (waiting == 0 && longest_wait < SCALE_UP_ORDER_WAIT) {
+        if (++sup->idle_periods >= IDLE_PERIODS && active > config.waiters) {
+            // Stop giving it customers first, then tell it
+            if (env_wait(env, TABLE_LOCK) == -1) return 0;
+            seq_write_begin(&shm->tables.seq);
+            send_home = --shm->tables.active_waiters;
+            seq_write_end(&shm->tables.seq);
+            env_signal(env, TABLE_LOCK);
+            sup->on_duty--;
+            sup->idle_periods = 0;
+        }
+    } else {
+        sup->idle_periods = 0;
+    }
+
+    int hired = 0;
+    if (send_home != -1) {
+        struct waiter_area *area = WAITER_AREA(shm, send_home);
+        if (env_wait(env, WAITER_QUEUE_LOCK(send_home)) == -1) return 0;
+        seq_write_begin(&area->seq);
+        area->retire = 1;
+        seq_write_end(&area->seq);
+        env_signal_many(env, (int[]){WAITER_SEM(send_home), WAITER_QUEUE_LOCK(send_home)}, 2);
+    } else if ((waiting > SCALE_UP_BACKLOG * active || longest_wait >= SCALE_UP_ORDER_WAIT) &&
+               active < config.max_waiters && !WAITER_STATS(shm, active)->on_duty) {
+        // The next id, once a waiter sent home from it has left. Nothing
+        // can be queued for it then; clear what the last one left behind,
+        // down to a send-home wake-up it did not need to take.
+        struct waiter_area *area = WAITER_AREA(shm, active);
+        if (env_wait(env, WAITER_QUEUE_LOCK(active)) == -1) return 0;
+        if (area->po == 0 && food_ready(area) == 0) {
+            seq_write_begin(&area->seq);
+            area->busy = 0;
+            area->retire = 0;
+            area->steal_hint = 0;
+            area->longest_wait = 0;
+            seq_write_end(&area->seq);
+            while (env_trywait(env, WAITER_SEM(active)) == 0) {
+                // Drain
+            }
+            hired = 1;
+        }
+        env_signal(env, WAITER_QUEUE_LOCK(active));
+    }
+    if (hired) {
+        sup->hire(active);
+        sup->on_duty++;
+        if (env_wait(env, TABLE_LOCK) == -1) return 0;
+        seq_write_begin(&shm->tables.seq);
+        shm->tables.active_waiters = active + 1;
+        seq_write_end(&shm->tables.seq);
+        env_signal(env, TABLE_LOCK);
+    }
+    stats_pool(shm, 0, hired, 0, alive * SUPERVISE_PERIOD);
+    return 1;
+}
+
+struct act supervisor_step(struct supervisor *sup) {
+    struct restaurant_shm *shm = sup->env.shm;
+    switch (sup->state) {
+    case SUPERVISOR_START:
+        // Join the handshake, and wait for customer to open so that the
+        // periods are not spent before the restaurant opens
+        __atomic_fetch_add(&shm->ready, 1, __ATOMIC_RELEASE);
+        sup->state = SUPERVISOR_OPENED;
+        return act_wait(OPENED(sup->pool));
+
+    case SUPERVISOR_OPENED:
+        sup->next_time = clock_now(shm);
+        break;
+
+    case SUPERVISOR_TICK:
+        if (!(sup->pool == 0 ? supervise_cooks(sup) : supervise_waiters(sup))) return act_done();
+        break;
+    }
+    sup->next_time += SUPERVISE_PERIOD;
+    sup->state = SUPERVISOR_TICK;
+    return act_sleep(sup->next_time, SUPERVISE_PERIOD);
+}
@@ -0,0 +1,147 @@
+#ifndef ACTORS_H
+#define ACTORS_H
+
+#include "restaurant.h"
+#include "custfile.h"
+
+// The cooks, waiters, customers and supervisors, and the door of customer
+// main that lets the customers in. cook, waiter and customer run each of
+// them in a process of its own; engine runs them all in one process (see
+// engine.c). Both run this same code.
+//
+// An actor's code runs in steps, from one point where it waits on an event
+// semaphore or sleeps to the next. Its step function carries on from where
+// the last step stopped and returns what the actor does next; the program
+// carries that out (act_perform(), or engine.c's scheduler) and calls the
+// step again. Within a step an actor only takes locks, and never holds one
+// across a step, so engine.c runs a step to its end without interruption.
+
+// What an actor does next
+#define ACT_WAIT 0              // wait on semaphore sem
+#define ACT_SLEEP 1             // sleep until simulated minute `until`
+#define ACT_DONE 2              // nothing, it has finished
+
+struct act {
+    int kind;
+    int sem;
+    int until;
+    int minutes;                // ACT_SLEEP: the sleep, for real time
+};
+
+// How the actors reach the semaphores, by the set's semid. cook, waiter
+// and customer pass their sema_*() wrappers around sync.c, which print the
+// program's leaving line and exit once the set has been removed; the
+// supervisors pass sync.c's own and stop when one fails. engine.c passes
+// its scheduler's. Returns as for sync.h.
+struct actor_ops {
+    int (*wait)(int semid, int sem_num);
+    int (*trywait)(int semid, int sem_num);
+    int (*signal)(int semid, int sem_num);
+    int (*signal_many)(int semid, const int *sem_nums, int n);
+};
+
+struct actor_env {
+    struct restaurant_shm *shm;
+    int semid;
+    const struct actor_ops *ops;
+};
+
+// Carry out a wait or sleep in this process: env's wait, or sync_sleep().
+// Returns -1 if it failed.
+int act_perform(const struct actor_env *env, struct act act);
+
+// Set shm->open and wake the supervisors waiting for it
+void restaurant_open(const struct actor_env *env);
+
+struct cook {
+    struct actor_env env;
+    int id;
+    int state;
+    struct cook_order *batch;   // batch_orders, freed once done
+    int batch_size;
+    int persons;
+    int curr_time;
+    int cook_time;
+    int last_time;              // for the Leaving line, see cook_leaving()
+    int last_time_cook;
+    int last_cook_id;
+};
+
+void cook_init(struct cook *cook, const struct actor_env *env, int cook_id);
+struct act cook_step(struct cook *cook);
+// The line a cook prints when the semaphores are removed under it
+void cook_leaving(struct cook *cook);
+
+struct waiter {
+    struct actor_env env;
+    int id;
+    int state;
+    int outstanding;            // orders placed whose food has not been served
+    int sent_home;
+    int food_slot;
+    int have_customer;
+    int ticket;                 // the send-home or a steal hint, no work of its own
+    int curr_time;
+    int retry_time;
+    struct waiting_customer customer;
+    struct cook_order order;
+};
+
+void waiter_init(struct waiter *waiter, const struct actor_env *env, int waiter_id);
+struct act waiter_step(struct waiter *waiter);
+// The line a waiter prints when the semaphores are removed under it;
+// woken: it was in a wait
+void waiter_leaving(struct waiter *waiter, int woken);
+
+struct customer {
+    struct actor_env env;
+    int id;
+    int state;
+    int arrival_time;
+    int count;
+    int curr_time;
+    int curr_time2;
+    int slot;
+};
+
+void customer_init(struct customer *customer, const struct actor_env *env,
+                   const struct customer_record *record);
+struct act customer_step(struct customer *customer);
+
+// Customer main's loop over the list: sleeps until each arrival and hands
+// the record to admit(), which starts the customer and adds it to started.
+// Once the list is over it calls list_done(), if set, and then waits on
+// CUSTOMER_DONE until as many customers (and pool workers, which the
+// program counts in started) have finished.
+struct door {
+    struct actor_env env;
+    struct custfile *customers;
+    int state;
+    int prev_arrival_time;
+    int started;
+    int finished;
+    struct customer_record record;
+    void (*admit)(struct door *door, const struct customer_record *record);
+    void (*list_done)(struct door *door);
+};
+
+void door_init(struct door *door, const struct actor_env *env, struct custfile *customers);
+struct act door_step(struct door *door);
+
+// Supervisor of an elastic pool, pool 0 the cooks and 1 the waiters (see
+// SUPERVISE_PERIOD). It knows who is on duty from their on_duty flags,
+// and starts a cook or waiter with hire(id), which sets the flag.
+struct supervisor {
+    struct actor_env env;
+    int pool;
+    int state;
+    int next_time;
+    int idle_periods;
+    int on_duty;                // cooks or waiters, not counting those sent home
+    void (*hire)(int id);
+};
+
+void supervisor_init(struct supervisor *sup, const struct actor_env *env, int pool, void (*hire)(int id));
+struct act supervisor_step(struct supervisor *sup);
+
+#endif
@@ -0,0 +1,172 @@
+#!/bin/sh
+# Benchmark of the whole pipeline, run by make bench after an optimized
+# build. Runs cook, waiter and customer on generated customer lists at
+# several load levels and staff/table topologies, in virtual time so the
+# wall time is what the programs themselves cost, not the simulated day.
+#
+# Every configuration is run BENCH_REPEAT times and the fastest run is
+# appended to BENCH_OUTPUT as one line of JSON: the configuration, wall
+# time, served customers per second, semaphore system calls and the
+# latency percentiles (see stats_json() in restaurant.c).
+#
+# A day in virtual time is deterministic, so the served count and the
+# customer wait mean, p50 and p99 of every configuration must match
+# BENCH_BASELINE exactly. That file is committed; a difference means the
+# behaviour of the restaurant changed, not its speed. Throughput depends
+# on the machine, so it is compared only against BENCH_THROUGHPUT, which
+# ./bench.sh -u stores on this machine and which is never committed.
+# Fails on a difference in the deterministic figures, if a configuration
+# serves fewer customers per second than BENCH_TOLERANCE (a fraction)
+# below its local figure, or if BENCH_BASELINE is missing.
+#   ./bench.sh       run and compare
+#   ./bench.sh -u    run and store the results as the new baselines
+#   ./bench.sh -n    run without comparing
+
+OUTPUT=${BENCH_OUTPUT:-bench_output.txt}
+BASELINE=${BENCH_BASELINE:-bench_baseline.txt}
+THROUGHPUT=${BENCH_THROUGHPUT:-bench_throughput.txt}
+TOLERANCE=${BENCH_TOLERANCE:-0.3}
+REPEAT=${BENCH_REPEAT:-5}
+
+update=0
+compare=1
+if [ "$1" = "-u" ]; then
+    update=1
+    compare=0
+elif [ "$1" = "-n" ]; then
+    compare=0
+elif [ $# -gt 0 ]; then
+    echo "Usage: $0 [-u | -n]" >&2
+    exit 1
+fi
+if [ $compare -eq 1 ] && [ ! -f "$BASELINE" ]; then
+    echo "no $BASELINE to compare against: make bench-baseline stores one," >&2
+    echo "or run ./bench.sh -n to skip the comparison" >&2
+    exit 1
+fi
+
+# name:gencustomers options
+LOADS="light:-n 240 -r 1
+busy:-n 960 -r 4
+rush:-n 2400 -r 10 -a bursty"
+
+# name:cook options:customer options
+TOPOLOGIES="small:-c 2 -w 5 -t 10:
+large:-c 8 -w 16 -t 120:
+elastic:-c 2 -C 8 -w 4 -W 16 -t 120 -S:
+pool:-c 8 -w 16 -t 120:-p 128"
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+: > "$OUTPUT"
+
+# One day: cook and waiter in the background, customer in front. The
+# stats tool only succeeds once cook has set up the segment and the
+# semaphores, so it tells when waiter can attach.
+run_day() {
+    ./cook -v $2 < /dev/null > /dev/null 2> "$work/cook.err" &
+    cook_pid=$!
+    tries=0
+    until ./stats < /dev/null > /dev/null 2>&1; do
+        tries=$((tries + 1))
+        if [ $tries -gt 200 ] || ! kill -0 $cook_pid 2> /dev/null; then
+            echo "$1: cook did not start" >&2
+            cat "$work/cook.err" >&2
+            return 1
+        fi
+        sleep 0.05
+    done
+    ./waiter < /dev/null > /dev/null 2> "$work/waiter.err" &
+    waiter_pid=$!
+    timeout 120 ./customer -f "$work/customers.txt" -m "$work/metrics" $3 \
+        < /dev/null > /dev/null 2> "$work/customer.err"
+    status=$?
+    if [ $status -ne 0 ]; then
+        echo "$1: customer failed" >&2
+        cat "$work/customer.err" >&2
+        kill $cook_pid $waiter_pid 2> /dev/null
+    fi
+    # They leave once customer has removed the semaphores
+    wait $cook_pid $waiter_pid
+    return $status
+}
+
+# Value of a numeric field in a JSON line
+field() {
+    sed 's/.*"'"$1"'":\([-0-9.]*\).*/\1/'
+}
+
+failed=0
+echo "$LOADS" | while IFS=: read -r load genopts; do
+    ./gencustomers $genopts -s 1 > "$work/customers.txt" || exit 1
+    echo "$TOPOLOGIES" | while IFS=: read -r topology cookopts custopts; do
+        name="$topology/$load"
+        : > "$work/metrics"
+        for i in $(seq "$REPEAT"); do
+            run_day "$name" "$cookopts" "$custopts" || exit 1
+        done
+        # The fastest run, with the configuration in front
+        best=$(awk -F'"served_per_s":' '{ split($2, v, ","); if (v[1] + 0 > max) { max = v[1] + 0; line = $0 } }
+                   END { print line }' "$work/metrics")
+        printf '{"name":"%s","load":"%s","cook":"%s","customer":"%s","runs":%d,%s\n' \
+            "$name" "$genopts" "$cookopts" "$custopts" "$REPEAT" "${best#\{}" >> "$OUTPUT"
+    done || exit 1
+done || exit 1
+
+# Name and served per second, then the deterministic figures: served,
+# customer wait mean, p50 and p99
+figures() {
+    echo "$(echo "$1" | sed 's/.*"name":"\([^"]*\)".*/\1/')" \
+        "$(echo "$1" | field served_per_s)" "$(echo "$1" | field served)" \
+        "$(echo "$1" | field customer_wait_mean)" "$(echo "$1" | field customer_wait_p50)" \
+        "$(echo "$1" | field customer_wait_p99)"
+}
+
+if [ $compare -eq 1 ] && [ ! -f "$THROUGHPUT" ]; then
+    echo "no $THROUGHPUT on this machine: throughput is not compared" >&2
+fi
+
+echo "config              wall s  served   per s  syscalls  wait p50  p99  local"
+while read -r line; do
+    set -- $(figures "$line")
+    name=$1
+    rate=$2
+    shift 2
+    base=$(awk -v n="$name" '$1 == n { print $2 }' "$THROUGHPUT" 2> /dev/null)
+    verdict=""
+    if [ $compare -eq 1 ]; then
+        expect=$(awk -v n="$name" '$1 == n { print $2, $3, $4, $5 }' "$BASELINE")
+        if [ "$*" != "$expect" ]; then
+            verdict="CHANGED (served, wait mean p50 p99: $* against ${expect:-none})"
+            failed=1
+        elif [ -n "$base" ] && awk -v r="$rate" -v b="$base" -v t="$TOLERANCE" 'BEGIN { exit !(r < b * (1 - t)) }'; then
+            verdict="REGRESSED"
+            failed=1
+        fi
+    fi
+    printf "%-18s %7s %7s %7s %9s %9s %4s  %s %s\n" "$name" \
+        "$(echo "$line" | field wall_s | cut -c1-6)" "$1" "$rate" \
+        "$(echo "$line" | field syscalls)" "$3" "$4" "${base:--}" "$verdict"
+done < "$OUTPUT"
+echo "results in $OUTPUT"
+
+if [ $update -eq 1 ]; then
+    {
+        echo "# name, served, customer wait mean p50 p99 of a virtual-time day (./bench.sh -u)"
+        while read -r line; do
+            set -- $(figures "$line")
+            echo "$1 $3 $4 $5 $6"
+        done < "$OUTPUT"
+    } > "$BASELINE"
+    {
+        echo "# served customers per second of wall time, stored on $(uname -n) by ./bench.sh -u"
+        while read -r line; do
+            set -- $(figures "$line")
+            echo "$1 $2"
+        done < "$OUTPUT"
+    } > "$THROUGHPUT"
+    echo "baselines stored in $BASELINE and $THROUGHPUT"
+elif [ $failed -ne 0 ]; then
+    echo "results differ from $BASELINE, or throughput regressed by more than $TOLERANCE" >&2
+    exit 1
+fi
@@ -0,0 +1,97 @@
+#!/bin/sh
+# Regression check, run by make check. A day in virtual time is
+# deterministic (see sync.h), so two runs of the same configuration must
+# print the same cook, waiter and customer traces, byte for byte. Each
+# configuration is run twice and the traces compared; the first run's
+# are kept in CHECK_OUTPUT for diffing against another build. Those
+# without a worker pool are also run on the engine, which shares the
+# actors' code but has a scheduler of its own, and must print the same.
+# The waiters configuration must also call in a waiter after opening and
+# send one home.
+#   ./check.sh
+
+OUTPUT=${CHECK_OUTPUT:-check_output}
+
+# name:customer list:cook options:customer options
+CONFIGS="default:customers.txt::
+elastic:generated:-c 2 -C 6 -w 3 -W 8 -t 20 -S:
+pool:generated:-c 4 -w 6 -t 30:-p 40
+rush:rush:-c 3 -w 4 -t 15 -P sjf -A shortest -b 3:
+waiters:rush:-c 3 -C 8 -w 1 -W 4 -t 30:"
+
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+mkdir -p "$OUTPUT" || exit 1
+./gencustomers -n 400 -r 2 -s 1 > "$work/generated" || exit 1
+./gencustomers -n 600 -r 6 -a bursty -s 2 > "$work/rush" || exit 1
+
+# One day, with the traces in $work/$2.*. The stats tool only succeeds
+# once cook has set up the segment and the semaphores, so it tells when
+# waiter can attach.
+run_day() {
+    ./cook -v $3 < /dev/null > "$work/$2.cook" 2> "$work/cook.err" &
+    cook_pid=$!
+    tries=0
+    until ./stats < /dev/null > /dev/null 2>&1; do
+        tries=$((tries + 1))
+        if [ $tries -gt 200 ] || ! kill -0 $cook_pid 2> /dev/null; then
+            echo "$1: cook did not start" >&2
+            cat "$work/cook.err" >&2
+            return 1
+        fi
+        sleep 0.05
+    done
+    ./waiter < /dev/null > "$work/$2.waiter" 2> "$work/waiter.err" &
+    waiter_pid=$!
+    timeout 60 ./customer -f "$5" $4 < /dev/null > "$work/$2.customer" 2> "$work/customer.err"
+    status=$?
+    if [ $status -ne 0 ]; then
+        echo "$1: customer failed" >&2
+        cat "$work/customer.err" >&2
+        kill $cook_pid $waiter_pid 2> /dev/null
+    fi
+    # They leave once customer has removed the semaphores
+    wait $cook_pid $waiter_pid
+    return $status
+}
+
+failed=0
+while IFS=: read -r name list cookopts custopts; do
+    [ "$list" = "customers.txt" ] || list="$work/$list"
+    run_day "$name" first "$cookopts" "$custopts" "$list" || exit 1
+    run_day "$name" second "$cookopts" "$custopts" "$list" || exit 1
+    verdict="ok"
+    for trace in cook waiter customer; do
+        cp "$work/first.$trace" "$OUTPUT/$name.$trace"
+        if ! cmp -s "$work/first.$trace" "$work/second.$trace"; then
+            verdict="DIFFERS"
+            failed=1
+            diff "$work/first.$trace" "$work/second.$trace" | head -5 >&2
+        fi
+    done
+    if [ "$name" = "waiters" ] && ! { grep -v '^\[11:00 am\]' "$work/first.waiter" | grep -q 'is ready' &&
+                                      grep -q 'sent home' "$work/first.waiter"; }; then
+        verdict="no waiter called in and sent home"
+        failed=1
+    fi
+    if [ -z "$custopts" ]; then
+        ./engine $cookopts "$list" "$work/engine.cook" "$work/engine.waiter" "$work/engine.customer" \
+            2> "$work/engine.err" || { cat "$work/engine.err" >&2; exit 1; }
+        for trace in cook waiter customer; do
+            if ! cmp -s "$work/first.$trace" "$work/engine.$trace"; then
+                verdict="engine DIFFERS"
+                failed=1
+                diff "$work/first.$trace" "$work/engine.$trace" | head -5 >&2
+            fi
+        done
+    fi
+    printf "%-10s %5s served  %s\n" "$name" "$(grep -c 'gets food' "$work/first.customer")" "$verdict"
+done <<EOF
+$CONFIGS
+EOF
+
+if [ $failed -ne 0 ]; then
+    echo "virtual time runs are not deterministic, the engine disagrees, or the waiter pool did not change" >&2
+    exit 1
+fi
+echo "traces in $OUTPUT"
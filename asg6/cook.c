@@ -7,184 +7,64 @@
 #include <sys/sem.h>
 #include <sys/wait.h>
 #include <time.h>
+#include <errno.h>
 
-#define SHM_SIZE 2000
-#define TIME_SCALE 100000 // 100ms = 100000 microseconds per minute
+#include "sync.h"
+#include "restaurant.h"
+#include "actors.h"
 
-// Constants for shared memory organization
-#define TIME_INDEX 0
-#define EMPTY_TABLES_INDEX 1
-#define NEXT_WAITER_INDEX 2
-#define PENDING_ORDERS_INDEX 3
+// This process's cook, for the leaving lines
+static struct cook cook;
 
-// Waiter areas in shared memory
-#define WAITER_U_START 100
-#define WAITER_V_START 300
-#define WAITER_W_START 500
-#define WAITER_X_START 700
-#define WAITER_Y_START 900
-#define COOK_QUEUE_START 1100
-
-// Semaphore indices
-#define MUTEX 0
-#define COOK_SEM 1
-#define WAITER_U 2
-#define WAITER_V 3
-#define WAITER_W 4
-#define WAITER_X 5
-#define WAITER_Y 6
-#define CUSTOMER_START 7
-
-int last_time;
-int last_time_cook;
-char last_cook_name;
-int global_shm;
+// For the supervisor: pids by id, up to max_cooks, 0 for an id that is free
+static pid_t *cook_pids;
+static int cook_shmid;
+static int cook_semid;
+static struct restaurant_shm *cook_shm;
 
 // Semaphore operations
-union semun {
-    int val;
-    struct semid_ds *buf;
-    unsigned short *array;
-};
-
-void print_cook_ending() {
-    if(last_time_cook == last_time) printf("Cook %c:Leaving\n", last_cook_name);
-}
-
-// Function to display current time
-void print_time(int minutes) {
-    int hour = 11 + minutes / 60;
-    int minute = minutes % 60;
-    char am_pm = (hour < 12) ? 'a' : 'p';
-    // int last_time = minutes;
-    if (hour > 12) hour -= 12;
-    printf("[%d:%02d %cm] ", hour, minute, am_pm);
+int sema_wait(int semid, int sem_num) {
+    if (sync_wait(semid, sem_num) == -1) {
+        cook_leaving(&cook);
+        exit(1);
+    }
+    return 0;
 }
 
-// Semaphore operations
-void sem_wait(int semid, int sem_num) {
-    struct sembuf sb = {sem_num, -1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        print_time(last_time);
-        print_cook_ending();
+int sema_signal(int semid, int sem_num) {
+    if (sync_signal(semid, sem_num) == -1) {
+        log_put(LOG_COOK_LEAVING, cook.last_time, 0, 0, 0, 0);
         exit(1);
     }
+    return 0;
 }
 
-void sem_signal(int semid, int sem_num) {
-    struct sembuf sb = {sem_num, 1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        print_time(last_time);
+// Several signals in one call, e.g. a wake-up and then the unlock
+int sema_signal_many(int semid, const int *sem_nums, int n) {
+    if (sync_signal_many(semid, sem_nums, n) == -1) {
+        log_put(LOG_COOK_LEAVING, cook.last_time, 0, 0, 0, 0);
         exit(1);
     }
+    return 0;
 }
 
-// Function to implement cook behavior
+static const struct actor_ops cook_ops = {sema_wait, sync_trywait, sema_signal, sema_signal_many};
+// The supervisor stops when the semaphores are removed, see supervise_cooks()
+static const struct actor_ops supervisor_ops = {sync_wait, sync_trywait, sync_signal, sync_signal_many};
+
+// Function to implement cook behavior, see cook_step() in actors.c
 void cmain(int cook_id, int shmid, int semid) {
-    int *shm = (int *)shmat(shmid, NULL, 0);
-    if (shm == (int *)-1) {
+    struct restaurant_shm *shm = shmat(shmid, NULL, 0);
+    if (shm == (void *)-1) {
         perror("shmat");
         exit(1);
     }
 
-    // char cook_name = (cook_id == 0) ? 'C' : 'D';
-    
-    // Print cook is ready
-    sem_wait(semid, MUTEX);
-    int curr_time = shm[TIME_INDEX];
-    print_time(curr_time);
-    if (cook_id == 0) {
-        printf("Cook C is ready\n");
-    } else {
-        printf("\tCook D is ready\n");
-    }
-    sem_signal(semid, MUTEX);
-
-    while (1) {
-        // Wait until woken up by a waiter
-        sem_wait(semid, COOK_SEM);
-        
-        // Check if it's after 3:00pm and the cooking queue is empty
-        sem_wait(semid, MUTEX);     // wait until no other process is accessing the shared variable time.
-        curr_time = shm[TIME_INDEX];
-        int pending_orders = shm[PENDING_ORDERS_INDEX];
-        
-        if (curr_time > 240 && pending_orders == 0) {  // 240 mins = 4 hours after 11am = 3pm
-            // Wake up all waiters
-            sem_signal(semid, WAITER_U);
-            sem_signal(semid, WAITER_V);
-            sem_signal(semid, WAITER_W);
-            sem_signal(semid, WAITER_X);
-            sem_signal(semid, WAITER_Y);
-            sem_signal(semid, MUTEX);
-            break;
-        }
-
-        // If there are no pending orders, continue waiting
-        if (pending_orders == 0) {
-            sem_signal(semid, MUTEX);
-            continue;
-        }
-
-        // Get a cooking request from the queue
-        int order_index = COOK_QUEUE_START;
-        int waiter_id = shm[order_index];
-        int customer_id = shm[order_index + 1];
-        int customer_count = shm[order_index + 2];
-        
-        // Remove this order from the queue by shifting the queue
-        for (int i = 0; i < (pending_orders - 1) * 3; i++) {
-            shm[order_index + i] = shm[order_index + i + 3];
-        }
-        
-        shm[PENDING_ORDERS_INDEX]--;
-        
-        // Print starting order preparation
-        print_time(curr_time);
-        if (cook_id == 0) {
-            printf("Cook C: Preparing order (Waiter %c, Customer %d, Count %d)\n", 
-                   'U' + waiter_id, customer_id, customer_count);
-        } else {
-            printf("\tCook D: Preparing order (Waiter %c, Customer %d, Count %d)\n", 
-                   'U' + waiter_id, customer_id, customer_count);
-        }
-        sem_signal(semid, MUTEX);
-        
-        // Cook prepares food (5 minutes per person)
-        int cook_time = 5 * customer_count;
-        usleep(cook_time * TIME_SCALE);
-        
-        // Update the time after cooking
-        sem_wait(semid, MUTEX);
-        int new_time = curr_time + cook_time;
-        if (new_time > shm[TIME_INDEX]) {
-            shm[TIME_INDEX] = new_time;
-        }
-        
-        // Store the customer ID in the waiter's FR area
-        int waiter_area_start = WAITER_U_START + waiter_id * 200;
-        shm[waiter_area_start] = customer_id;  // FR area
-        
-        // Notify the waiter that food is ready
-        print_time(shm[TIME_INDEX]);
-        if (cook_id == 0) {
-            last_cook_name = 'C';
-            last_time_cook = shm[TIME_INDEX];
-            printf("Cook C: Prepared order (Waiter %c, Customer %d, Count %d)\n", 
-                   'U' + waiter_id, customer_id, customer_count);
-        } else {
-            last_time_cook = shm[TIME_INDEX];
-            last_cook_name = 'D';
-            printf("\tCook D: Prepared order (Waiter %c, Customer %d, Count %d)\n", 
-                   'U' + waiter_id, customer_id, customer_count);
-        }
-        if(shm[TIME_INDEX] > last_time){
-            last_time = shm[TIME_INDEX];
-        }
-        sem_signal(semid, MUTEX);
-        
-        // Signal the waiter
-        sem_signal(semid, WAITER_U + waiter_id);
+    struct actor_env env = {shm, semid, &cook_ops};
+    cook_init(&cook, &env, cook_id);
+    struct act act;
+    while ((act = cook_step(&cook)).kind != ACT_DONE) {
+        act_perform(&cook.env, act);
     }
     
     // Detach from shared memory
@@ -193,10 +73,69 @@ void cmain(int cook_id, int shmid, int semid) {
         exit(1);
     }
     
+    sync_actor_done(semid);
     exit(0);
 }
 
-int main() {
+static pid_t spawn_cook(struct restaurant_shm *shm, int cook_id, int shmid, int semid) {
+    int actor = sync_actor_add(semid);
+    if (actor == -1) {
+        perror("sync_actor_add");
+        exit(1);
+    }
+    COOK_STATS(shm, cook_id)->on_duty = 1;
+    pid_t pid = fork();
+    if (pid == -1) {
+        fprintf(stderr, "fork cook %s: ", cook_name(cook_id));
+        perror(NULL);
+        exit(1);
+    } else if (pid == 0) {
+        // Child process for the cook, once it is its turn
+        if (sync_actor_begin(semid, actor) == -1) exit(1);
+        cmain(cook_id, shmid, semid);
+        // Never returns
+    }
+    return pid;
+}
+
+// Called in by the supervisor
+static void hire_cook(int cook_id) {
+    cook_pids[cook_id] = spawn_cook(cook_shm, cook_id, cook_shmid, cook_semid);
+}
+
+// Supervisor for an elastic cook pool, see supervisor_step() in actors.c.
+// Returns once the day is over.
+static void supervise_cooks(struct restaurant_shm *shm, int shmid, int semid) {
+    // Join the handshake
+    int actor = sync_actor_add(semid);
+    if (actor == -1 || sync_actor_begin(semid, actor) == -1) {
+        perror("sync_actor_add");
+        exit(1);
+    }
+    cook_shm = shm;
+    cook_shmid = shmid;
+    cook_semid = semid;
+    struct actor_env env = {shm, semid, &supervisor_ops};
+    struct supervisor sup;
+    supervisor_init(&sup, &env, 0, hire_cook);
+    struct act act;
+    while ((act = supervisor_step(&sup)).kind != ACT_DONE && act_perform(&env, act) != -1) {
+        // Reap the cooks that have gone home. They say so before they
+        // finish, so this waits at most for their exit.
+        for (int i = 0; i < config.max_cooks; i++) {
+            if (cook_pids[i] > 0 && !COOK_STATS(shm, i)->on_duty) {
+                waitpid(cook_pids[i], NULL, 0);
+                cook_pids[i] = 0;
+            }
+        }
+    }
+    sync_actor_done(semid);
+}
+
+int main(int argc, char *argv[]) {
+    // Restaurant size and options, see restaurant.c for the flags
+    config_parse(argc, argv);
+
     // Create a key for shared memory and semaphores
     key_t key = ftok("./cook", 'R');
     if (key == -1) {
@@ -204,93 +143,117 @@ int main() {
         exit(1);
     }
     
-    // Create shared memory
-    int shmid = shmget(key, SHM_SIZE * sizeof(int), IPC_CREAT | 0666);
+    // Create shared memory, replacing a segment of another size left over
+    // from an earlier run
+    int shmid = shmget(key, shm_size(), IPC_CREAT | 0666);
+    if (shmid == -1 && errno == EINVAL) {
+        shmctl(shmget(key, 0, 0666), IPC_RMID, NULL);
+        shmid = shmget(key, shm_size(), IPC_CREAT | 0666);
+    }
     if (shmid == -1) {
         perror("shmget");
         exit(1);
     }
     
     // Attach to shared memory
-    int *shm = (int *)shmat(shmid, NULL, 0);
-    if (shm == (int *)-1) {
+    struct restaurant_shm *shm = shmat(shmid, NULL, 0);
+    if (shm == (void *)-1) {
         perror("shmat");
         exit(1);
     }
     
-    // Initialize shared memory
-    shm[TIME_INDEX] = 0;  // Time is 11:00am
-    shm[EMPTY_TABLES_INDEX] = 10;  // 10 empty tables
-    shm[NEXT_WAITER_INDEX] = 0;  // First waiter is U (index 0)
-    shm[PENDING_ORDERS_INDEX] = 0;  // No pending orders initially
+    // Initialize shared memory: header, tables, queues and log rings
+    shm_init(shm);
     
-    // Create semaphores (1 mutex, 1 cook, 5 waiters, and space for customer semaphores)
-    int semid = semget(key, 207, IPC_CREAT | 0666);  // 7 + space for 200 customers
+    // Create semaphores (locks, cooks, waiters, and the customer wake-up slots)
+    int semid = sync_create(key, SYNC_AREA(shm), NUM_SEMS);
     if (semid == -1) {
-        perror("semget");
+        perror("sync_create");
+        exit(1);
+    }
+    // In virtual time there is no sleeping, the clock jumps from event to event
+    if (config.virtual_time &&
+        (sync_set_virtual(semid) == -1 || sync_set_clock(semid, &shm->time) == -1)) {
+        perror("sync_set_virtual");
         exit(1);
     }
     
     // Initialize semaphores
-    union semun arg;
-    arg.val = 1;  // Binary semaphore for mutex
-    if (semctl(semid, MUTEX, SETVAL, arg) == -1) {
-        perror("semctl mutex");
+    // Binary semaphore for mutex
+    if (sync_setval(semid, MUTEX, 1) == -1 ||
+        sync_setval(semid, TABLE_LOCK, 1) == -1 ||
+        sync_setval(semid, COOK_QUEUE_LOCK, 1) == -1 ||
+        sync_setval(semid, DISPATCH_LOCK, 1) == -1) {
+        perror("sync_setval mutex");
         exit(1);
     }
+    for (int i = 0; i < config.max_waiters; i++) {
+        if (sync_setval(semid, WAITER_QUEUE_LOCK(i), 1) == -1) {
+            perror("sync_setval waiter queue lock");
+            exit(1);
+        }
+    }
     
-    arg.val = 0;  // Initially no cook or waiter is woken up
-    if (semctl(semid, COOK_SEM, SETVAL, arg) == -1 ||
-        semctl(semid, WAITER_U, SETVAL, arg) == -1 ||
-        semctl(semid, WAITER_V, SETVAL, arg) == -1 ||
-        semctl(semid, WAITER_W, SETVAL, arg) == -1 ||
-        semctl(semid, WAITER_X, SETVAL, arg) == -1 ||
-        semctl(semid, WAITER_Y, SETVAL, arg) == -1) {
-        perror("semctl cook/waiter");
+    // Initially no cook or waiter is woken up
+    if (sync_setval(semid, COOK_SEM, 0) == -1) {
+        perror("sync_setval cook");
         exit(1);
     }
-    
-    // Initialize customer semaphores (if needed)
-    for (int i = 0; i < 200; i++) {
-        arg.val = 0;
-        if (semctl(semid, CUSTOMER_START + i, SETVAL, arg) == -1) {
-            perror("semctl customer");
+    for (int i = 0; i < config.max_waiters; i++) {
+        if (sync_setval(semid, WAITER_SEM(i), 0) == -1) {
+            perror("sync_setval waiter");
             exit(1);
         }
     }
     
-    // Detach from shared memory
-    if (shmdt(shm) == -1) {
-        perror("shmdt");
+    // The customer worker pool's dispatch queue starts empty
+    if (sync_setval(semid, DISPATCH_ITEMS, 0) == -1 ||
+        sync_setval(semid, DISPATCH_SPACE, DISPATCH_CAPACITY) == -1) {
+        perror("sync_setval dispatch");
         exit(1);
     }
     
-    // Create the two cooks
-    pid_t pid_c, pid_d;
+    // Initialize customer wake-up slots, one per table
+    for (int slot = 0; slot < config.tables; slot++) {
+        if (sync_setval(semid, CUSTOMER_SEM(slot), 0) == -1) {
+            perror("sync_setval customer");
+            exit(1);
+        }
+    }
+    
+    // The cooks inherit this attachment, which is where the semaphores are
+    // mapped for them, so it stays until they are done.
+    
+    // The trace is written by a drainer process, see log.h
+    log_attach(LOG_AREA(shm), LOG_COOK);
+    pid_t drainer = log_start_drainer();
     
-    pid_c = fork();
-    if (pid_c == -1) {
-        perror("fork cook C");
+    // Create the cooks; ids up to max_cooks are kept for the supervisor
+    cook_pids = (pid_t *)calloc(config.max_cooks, sizeof(pid_t));
+    if (cook_pids == NULL) {
+        perror("calloc");
         exit(1);
-    } else if (pid_c == 0) {
-        // Child process for cook C
-        cmain(0, shmid, semid);
-        // Never returns
+    }
+    for (int i = 0; i < config.cooks; i++) {
+        cook_pids[i] = spawn_cook(shm, i, shmid, semid);
     }
     
-    pid_d = fork();
-    if (pid_d == -1) {
-        perror("fork cook D");
-        exit(1);
-    } else if (pid_d == 0) {
-        // Child process for cook D
-        cmain(1, shmid, semid);
-        // Never returns
+    if (config.max_cooks > config.cooks) {
+        supervise_cooks(shm, shmid, semid);
     }
     
     // Parent waits for the cooks to terminate
-    waitpid(pid_c, NULL, 0);
-    waitpid(pid_d, NULL, 0);
+    for (int i = 0; i < config.max_cooks; i++) {
+        if (cook_pids[i] > 0) waitpid(cook_pids[i], NULL, 0);
+    }
+    free(cook_pids);
+    log_stop(drainer);
+    
+    // Detach from shared memory
+    if (shmdt(shm) == -1) {
+        perror("shmdt");
+        exit(1);
+    }
     
     return 0;
-}
\ No newline at end of file
+}
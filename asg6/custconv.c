@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "custfile.h"
+
+// Convert a customer list between the text and the binary format.
+//   custconv customers.txt customers.bin     text (or binary) to binary
+//   custconv -t customers.bin customers.txt  binary (or text) to text
+int main(int argc, char *argv[]) {
+    int to_text = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "t")) != -1) {
+        if (opt == 't') {
+            to_text = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [-t] input output\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (argc - optind != 2) {
+        fprintf(stderr, "Usage: %s [-t] input output\n", argv[0]);
+        exit(1);
+    }
+    const char *in_path = argv[optind];
+    const char *out_path = argv[optind + 1];
+
+    struct custfile in;
+    if (custfile_open(&in, in_path) == -1) {
+        perror(in_path);
+        exit(1);
+    }
+    FILE *out = fopen(out_path, to_text ? "w" : "wb");
+    if (out == NULL) {
+        perror(out_path);
+        exit(1);
+    }
+
+    // The record count goes in the header, which is rewritten at the end
+    struct custfile_header header = {CUSTFILE_MAGIC, CUSTFILE_VERSION, 0};
+    if (!to_text) fwrite(&header, sizeof(header), 1, out);
+
+    struct customer_record record;
+    while (custfile_next(&in, &record)) {
+        if (to_text) {
+            fprintf(out, "%d %d %d\n", record.customer_id, record.arrival_time, record.count);
+        } else {
+            fwrite(&record, sizeof(record), 1, out);
+        }
+        header.count++;
+    }
+    custfile_close(&in);
+
+    if (to_text) {
+        fprintf(out, "-1\n");
+    } else if (fseek(out, 0, SEEK_SET) == -1 || fwrite(&header, sizeof(header), 1, out) != 1) {
+        perror(out_path);
+        exit(1);
+    }
+    if (fclose(out) == EOF) {
+        perror(out_path);
+        exit(1);
+    }
+    fprintf(stderr, "%s: %lld customers\n", out_path, header.count);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "custfile.h"
+
+int custfile_open(struct custfile *cf, const char *path) {
+    cf->fp = NULL;
+    cf->records = NULL;
+    cf->map_size = 0;
+    cf->count = 0;
+    cf->next = 0;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return -1;
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    // A binary list starts with the magic number, text never does
+    struct custfile_header header;
+    if (st.st_size < (off_t)sizeof(header) ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != CUSTFILE_MAGIC) {
+        cf->fp = fdopen(fd, "r");
+        if (cf->fp == NULL) {
+            close(fd);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (header.version != CUSTFILE_VERSION || header.count < 0 ||
+        (st.st_size - (off_t)sizeof(header)) / (off_t)sizeof(struct customer_record) < header.count) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    cf->records = (const struct customer_record *)((char *)map + sizeof(header));
+    cf->map_size = st.st_size;
+    cf->count = header.count;
+    return 0;
+}
+
+int custfile_next(struct custfile *cf, struct customer_record *record) {
+    if (cf->fp != NULL) {
+        if (fscanf(cf->fp, "%d %d %d", &record->customer_id, &record->arrival_time,
+                   &record->count) != 3) return 0;
+        return record->customer_id != -1;
+    }
+    if (cf->next >= cf->count) return 0;
+    *record = cf->records[cf->next++];
+    return record->customer_id != -1;
+}
+
+void custfile_close(struct custfile *cf) {
+    if (cf->fp != NULL) fclose(cf->fp);
+    if (cf->records != NULL) {
+        munmap((char *)cf->records - sizeof(struct custfile_header), cf->map_size);
+    }
+    cf->fp = NULL;
+    cf->records = NULL;
+}
@@ -0,0 +1,42 @@
+#ifndef CUSTFILE_H
+#define CUSTFILE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "restaurant.h"
+
+// Customer lists, read one record at a time.
+//
+// Text format (customers.txt): "id arrival_time count" per line, ended by
+// a line starting with -1 or by the end of the file.
+//
+// Binary format: a struct custfile_header followed by `count` struct
+// customer_record, in the byte order of the machine that wrote it. It is
+// mapped into memory and read in place, see custconv.c to make one.
+
+#define CUSTFILE_MAGIC 0x53554352     // "RCUS" on little-endian machines
+#define CUSTFILE_VERSION 1
+
+struct custfile_header {
+    int magic;
+    int version;
+    long long count;
+};
+
+struct custfile {
+    FILE *fp;                               // text input
+    const struct customer_record *records;  // binary input, mapped
+    size_t map_size;
+    long long count;
+    long long next;
+};
+
+// Open a customer list, detecting its format. Returns -1 with errno set
+// (EINVAL for a bad binary header) on failure.
+int custfile_open(struct custfile *cf, const char *path);
+// Get the next record. Returns 1, or 0 at the end of the list.
+int custfile_next(struct custfile *cf, struct customer_record *record);
+void custfile_close(struct custfile *cf);
+
+#endif
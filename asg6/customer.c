@@ -9,181 +9,158 @@
 #include <time.h>
 #include <errno.h>
 
-#define SHM_SIZE 2000
-#define TIME_SCALE 100000 // 100ms = 100000 microseconds per minute
+#include "sync.h"
+#include "restaurant.h"
+#include "custfile.h"
+#include "actors.h"
 
-// Constants for shared memory organization
-#define TIME_INDEX 0
-#define EMPTY_TABLES_INDEX 1
-#define NEXT_WAITER_INDEX 2
-#define PENDING_ORDERS_INDEX 3
-
-// Waiter areas in shared memory
-#define WAITER_U_START 100
-#define WAITER_V_START 300
-#define WAITER_W_START 500
-#define WAITER_X_START 700
-#define WAITER_Y_START 900
-#define COOK_QUEUE_START 1100
-
-// Semaphore indices
-#define MUTEX 0
-#define COOK_SEM 1
-#define WAITER_U 2
-#define WAITER_V 3
-#define WAITER_W 4
-#define WAITER_X 5
-#define WAITER_Y 6
-#define CUSTOMER_START 7
-
-// For waiter area in shared memory
-#define FR_INDEX 0
-#define PO_INDEX 1
-#define QUEUE_START 2
-
-// Semaphore operations
-union semun {
-    int val;
-    struct semid_ds *buf;
-    unsigned short *array;
-};
-
-void sem_wait(int semid, int sem_num) {
-    struct sembuf sb = {sem_num, -1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        perror("semop wait");
+int sema_wait(int semid, int sem_num) {
+    if (sync_wait(semid, sem_num) == -1) {
+        perror("sync_wait");
         exit(1);
     }
+    return 0;
 }
 
-void sem_signal(int semid, int sem_num) {
-    struct sembuf sb = {sem_num, 1, 0};
-    if (semop(semid, &sb, 1) == -1) {
-        perror("semop signal");
+int sema_signal(int semid, int sem_num) {
+    if (sync_signal(semid, sem_num) == -1) {
+        perror("sync_signal");
         exit(1);
     }
+    return 0;
 }
 
-// Function to display current time
-void print_time(int minutes) {
-    int hour = 11 + minutes / 60;
-    int minute = minutes % 60;
-    char am_pm = (hour < 12) ? 'a' : 'p';
-    if (hour > 12) hour -= 12;
-    printf("[%d:%02d %cm] ", hour, minute, am_pm);
-}
-
-// Function to implement customer behavior
-void cmain(int customer_id, int arrival_time, int customer_count, int shmid, int semid) {
-    int *shm = (int *)shmat(shmid, NULL, 0);
-    if (shm == (int *)-1) {
-        perror("shmat");
+// Several signals in one call, e.g. an unlock and the wake-up that follows it
+int sema_signal_many(int semid, const int *sem_nums, int n) {
+    if (sync_signal_many(semid, sem_nums, n) == -1) {
+        perror("sync_signal_many");
         exit(1);
     }
-    
-    // Check current time and set arrival time if needed
-    sem_wait(semid, MUTEX);         // ********************************************************************************
-    if (arrival_time > shm[TIME_INDEX]) {
-        shm[TIME_INDEX] = arrival_time;
+    return 0;
+}
+
+static const struct actor_ops customer_ops = {sema_wait, sync_trywait, sema_signal, sema_signal_many};
+
+// Function to implement customer behavior, see customer_step() in
+// actors.c. Runs in a process of its own, or in a pool worker that serves
+// one customer after another.
+void cmain(struct restaurant_shm *shm, int semid, const struct customer_record *record) {
+    struct actor_env env = {shm, semid, &customer_ops};
+    struct customer customer;
+    customer_init(&customer, &env, record);
+    struct act act;
+    while ((act = customer_step(&customer)).kind != ACT_DONE) {
+        act_perform(&env, act);
     }
-    int curr_time = shm[TIME_INDEX];
-    
-    
-    // Check if it's after 3:00pm
-    if (curr_time > 240) {
-        print_time(curr_time);
-        printf(" 				Customer %d leaves (late arrival)\n", customer_id);
-        sem_signal(semid, MUTEX);
-        if (shmdt(shm) == -1) {
-            perror("shmdt");
-        }
-        exit(0);
+}
+
+// Pool worker: serve customers from the dispatch queue until told to stop
+void worker_main(struct restaurant_shm *shm, int semid) {
+    while (1) {
+        struct customer_record record;
+        sema_wait(semid, DISPATCH_ITEMS);
+        sema_wait(semid, DISPATCH_LOCK);
+        dispatch_pop(shm, &record);
+        sema_signal_many(semid, (int[]){DISPATCH_LOCK, DISPATCH_SPACE}, 2);
+        
+        if (record.customer_id == -1) break;
+        cmain(shm, semid, &record);
     }
     
-    // Check if any table is empty
-    if (shm[EMPTY_TABLES_INDEX] <= 0) {
-        print_time(curr_time);
-        printf(" 				Customer %d leaves (no empty table)\n", customer_id);
-        sem_signal(semid, MUTEX);
-        if (shmdt(shm) == -1) {
-            perror("shmdt");
-        }
-        exit(0);
-    }
+    sema_signal(semid, CUSTOMER_DONE);
+    sync_actor_done(semid);
+    exit(0);
+}
 
-    print_time(curr_time);
-    printf(" Customer %d arrives (count = %d)\n", customer_id, customer_count);
-    // Use an empty table
-    shm[EMPTY_TABLES_INDEX]--;
-    
-    // Find the waiter to serve
-    int waiter_id = shm[NEXT_WAITER_INDEX];
-    shm[NEXT_WAITER_INDEX] = (waiter_id + 1) % 5;  // Update next waiter in circular fashion
-    int waiter_area_start = WAITER_U_START + waiter_id * 200;
-    char waiter_name = 'U' + waiter_id;
-    
-    // Write to waiter's queue
-    int po_index = waiter_area_start + PO_INDEX;
-    int queue_index = waiter_area_start + QUEUE_START + (shm[po_index] * 2);
-    shm[queue_index] = customer_id;
-    shm[queue_index + 1] = customer_count;
-    shm[po_index]++;        // stores the number of pending orders.
-    
-    
-    sem_signal(semid, MUTEX);           // .............................................................................
+// Add the next actor, see sync_actor_add()
+static int actor_add(int semid) {
+    int actor = sync_actor_add(semid);
+    if (actor == -1) {
+        perror("sync_actor_add");
+        exit(1);
+    }
+    return actor;
+}
 
-    // wakeup the waiter
-    sem_signal(semid, WAITER_U + waiter_id);
-    
-    // Wait for the waiter to attend
-    sem_wait(semid, CUSTOMER_START + customer_id - 1);
+// Hand a record to the pool; waits while the dispatch queue is full
+void dispatch(struct restaurant_shm *shm, int semid, const struct customer_record *record) {
+    sema_wait(semid, DISPATCH_SPACE);
+    sema_wait(semid, DISPATCH_LOCK);
+    dispatch_push(shm, record);
+    sema_signal_many(semid, (int[]){DISPATCH_LOCK, DISPATCH_ITEMS}, 2);
+}
 
-    sem_wait(semid, MUTEX);
-    int tt = shm[TIME_INDEX];
-    sem_signal(semid, MUTEX);
+// Customer processes and workers not yet reaped; the drainer is not
+// counted, it only finishes after them
+static int children;
+static int pool_size;
 
-    print_time(tt);
-    printf("   Customer %d: Order placed to waiter %c\n", customer_id, waiter_name);
-    
-    // Wait for food to be served
-    sem_wait(semid, CUSTOMER_START + customer_id - 1);
-    
-    // Food is served, start eating
-    sem_wait(semid, MUTEX);
-    int curr_time2 = shm[TIME_INDEX];
-    int waiting_time = curr_time2 - curr_time;
-    print_time(curr_time2);
-    printf(" 	  Customer %d: gets food [waiting time = %d]\n", customer_id, waiting_time);
-    sem_signal(semid, MUTEX);
-    
-    // Eat for 30 minutes
-    usleep(30 * TIME_SCALE);
-    
-    // Update time after eating
-    sem_wait(semid, MUTEX);
-    int new_time = curr_time + 30;
-    if (new_time > shm[TIME_INDEX]) {
-        shm[TIME_INDEX] = new_time;
+// The door lets a customer in: to the pool, or in a process of its own
+static void admit(struct door *door, const struct customer_record *record) {
+    struct restaurant_shm *shm = door->env.shm;
+    int semid = door->env.semid;
+    if (pool_size > 0) {
+        dispatch(shm, semid, record);
+        return;
     }
     
-    // Free the table
-    shm[EMPTY_TABLES_INDEX]++;
-    
-    // print_time(shm[TIME_INDEX]);
-    print_time(curr_time2+30);
-    printf(" 		  Customer %d: Finished eating, leaving (%d tables available)\n", 
-           customer_id, shm[EMPTY_TABLES_INDEX]);
-    sem_signal(semid, MUTEX);
-    
-    // Detach from shared memory
-    if (shmdt(shm) == -1) {
-        perror("shmdt");
+    // Fork a child process for the customer
+    int actor = actor_add(semid);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork customer");
+        exit(1);
+    } else if (pid == 0) {
+        // Child process for the customer, it shares the parent's attachment
+        if (sync_actor_begin(semid, actor) == -1) _exit(1);
+        cmain(shm, semid, record);
+        sema_signal(semid, CUSTOMER_DONE);
+        sync_actor_done(semid);
+        // _exit: exit() would sync the inherited list stream, moving the
+        // shared file offset back under the parent's feet
+        _exit(0);
     }
     
-    exit(0);
+    // Reap the customers that have already left
+    children++;
+    door->started++;
+    while (children > 0 && waitpid(-1, NULL, WNOHANG) > 0) {
+        children--;
+    }
 }
 
-int main() {
+// Tell the pool workers to stop once the queue has drained
+static void stop_pool(struct door *door) {
+    for (int i = 0; i < pool_size; i++) {
+        struct customer_record stop = {-1, 0, 0};
+        dispatch(door->env.shm, door->env.semid, &stop);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // -f file: the customer list, text or binary (see custfile.h)
+    // -p N: serve the customers with a pool of N worker processes instead
+    // of forking one process per customer. A worker is busy for as long as
+    // its customer is in the restaurant, so N should be at least the number
+    // of tables plus one or arrivals get delayed.
+    // -m file: append the day's figures to file as a line of JSON, with
+    // the wall time from opening until the last customer has left
+    const char *customers_path = "customers.txt";
+    const char *metrics_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:p:m:")) != -1) {
+        if (opt == 'f') {
+            customers_path = optarg;
+        } else if (opt == 'p' && atoi(optarg) > 0) {
+            pool_size = atoi(optarg);
+        } else if (opt == 'm') {
+            metrics_path = optarg;
+        } else {
+            fprintf(stderr, "Usage: %s [-f customer file] [-p worker processes] [-m metrics file]\n", argv[0]);
+            exit(1);
+        }
+    }
+    
     // Create a key for shared memory and semaphores (same as cook.c)
     key_t key = ftok("./cook", 'R');
     if (key == -1) {
@@ -192,95 +169,122 @@ int main() {
     }
     
     // Get the shared memory segment
-    int shmid = shmget(key, SHM_SIZE * sizeof(int), 0666);
+    int shmid = shmget(key, 0, 0666);
     if (shmid == -1) {
         perror("shmget");
         exit(1);
     }
     
-    // Get the semaphores
-    int semid = semget(key, 207, 0666);
-    if (semid == -1) {
-        perror("semget");
+    // Attach to shared memory; the children inherit this mapping of the semaphores
+    struct restaurant_shm *main_shm = shmat(shmid, NULL, 0);
+    if (main_shm == (void *)-1) {
+        perror("shmat");
         exit(1);
     }
     
-    // Read customer info from file
-    FILE *fp = fopen("customers.txt", "r");
-    if (fp == NULL) {
-        perror("fopen");
+    // Check that cook laid the segment out the way this build expects, and
+    // load the configuration from it
+    struct shmid_ds seg;
+    if (shmctl(shmid, IPC_STAT, &seg) == -1) {
+        perror("shmctl");
+        exit(1);
+    }
+    if (shm_validate(main_shm, seg.shm_segsz) == -1) {
+        fprintf(stderr, "%s: shared memory layout does not match, rebuild and restart cook\n", argv[0]);
         exit(1);
     }
     
-    int prev_arrival_time = 0;
-    int customer_id, arrival_time, customer_count;
-    pid_t *customer_pids = NULL;
-    int num_customers = 0;
-    
-    // Count how many customers there are
-    int line_count = 0;
-    while (fscanf(fp, "%d %d %d", &customer_id, &arrival_time, &customer_count) == 3) {
-        if (customer_id == -1) break;
-        line_count++;
+    // Get the semaphores
+    int semid = sync_open(key, SYNC_AREA(main_shm), NUM_SEMS);
+    if (semid == -1) {
+        perror("sync_open");
+        exit(1);
     }
-    rewind(fp);
     
-    // Allocate array for customer PIDs
-    customer_pids = (pid_t*)malloc(line_count * sizeof(pid_t));
-    if (customer_pids == NULL) {
-        perror("malloc");
+    // Wait for the cooks and waiters to be ready, so that in virtual time
+    // the clock cannot run ahead of them
+    while (__atomic_load_n(&main_shm->ready, __ATOMIC_ACQUIRE) < config.cooks + config.waiters + SUPERVISORS) {
+        usleep(1000);
+    }
+    // This process too, for the arrival gaps. It stays an actor until the
+    // semaphores are removed, so that in virtual time nothing else moves
+    // between the last customer leaving and the end of the day.
+    if (sync_actor_begin(semid, actor_add(semid)) == -1) {
+        perror("sync_actor_begin");
         exit(1);
     }
+    // 11:00am is now; in real time every sleep is timed from here
+    if (!config.virtual_time && sync_set_epoch(semid, TIME_SCALE, config.absolute_time) == -1) {
+        perror("sync_set_epoch");
+        exit(1);
+    }
+    struct timespec opened, closed;
+    clock_gettime(CLOCK_MONOTONIC, &opened);
+    struct actor_env env = {main_shm, semid, &customer_ops};
+    restaurant_open(&env);
     
-    // Process customers
-    while (fscanf(fp, "%d %d %d", &customer_id, &arrival_time, &customer_count) == 3) {
-        if (customer_id == -1) break;
-        
-        // Wait for the time difference between consecutive customers
-        if (arrival_time > prev_arrival_time) {
-            int wait_time = arrival_time - prev_arrival_time;
-            usleep(wait_time * TIME_SCALE);
-            
-            // Update the shared memory time
-            int *shm = (int *)shmat(shmid, NULL, 0);
-            if (shm != (int *)-1) {
-                sem_wait(semid, MUTEX);
-                if (arrival_time > shm[TIME_INDEX]) {
-                    shm[TIME_INDEX] = arrival_time;
-                }
-                sem_signal(semid, MUTEX);
-                shmdt(shm);
-            }
-        }
-        prev_arrival_time = arrival_time;
-        
-        // Fork a child process for the customer
+    // The trace is written by a drainer process, see log.h
+    log_attach(LOG_AREA(main_shm), LOG_CUSTOMER);
+    pid_t drainer = log_start_drainer();
+    
+    // Start the worker pool before opening the list, so that the workers
+    // share nothing with the reader
+    for (int i = 0; i < pool_size; i++) {
+        int actor = actor_add(semid);
         pid_t pid = fork();
         if (pid == -1) {
-            perror("fork customer");
+            perror("fork worker");
             exit(1);
         } else if (pid == 0) {
-            // Child process for the customer
-            cmain(customer_id, arrival_time, customer_count, shmid, semid);
+            if (sync_actor_begin(semid, actor) == -1) exit(1);
+            worker_main(main_shm, semid);
             // Never returns
-        } else {
-            // Parent process
-            customer_pids[num_customers++] = pid;
         }
+        children++;
     }
     
-    fclose(fp);
+    // Read customer info from file, one record at a time
+    struct custfile customers;
+    if (custfile_open(&customers, customers_path) == -1) {
+        perror(customers_path);
+        exit(1);
+    }
     
-    // Wait for all customer processes to terminate
-    for (int i = 0; i < num_customers; i++) {
-        waitpid(customer_pids[i], NULL, 0);
+    // Process customers, see door_step() in actors.c; it returns once
+    // every customer has left
+    struct door door;
+    door_init(&door, &env, &customers);
+    door.started = pool_size;   // each worker says when it has finished too
+    door.admit = admit;
+    door.list_done = stop_pool;
+    struct act act;
+    while ((act = door_step(&door)).kind != ACT_DONE) {
+        act_perform(&env, act);
     }
+    custfile_close(&customers);
     
-    free(customer_pids);
+    // Then reap the processes
+    while (children > 0 && wait(NULL) > 0) {
+        children--;
+    }
+    log_stop(drainer);
+    clock_gettime(CLOCK_MONOTONIC, &closed);
+    stats_report(main_shm, semid, stderr);
+    sync_profile_report(semid, stderr, PROFILE_TOP, sem_name);
+    if (metrics_path != NULL) {
+        FILE *fp = fopen(metrics_path, "a");
+        if (fp == NULL) {
+            perror(metrics_path);
+        } else {
+            stats_json(main_shm, semid, (closed.tv_sec - opened.tv_sec) + (closed.tv_nsec - opened.tv_nsec) / 1e9, fp);
+            fclose(fp);
+        }
+    }
     
-    // Clean up IPC resources
+    // Clean up IPC resources; removing the semaphores tells the cooks and waiters to leave
+    sync_remove(semid);
+    shmdt(main_shm);
     shmctl(shmid, IPC_RMID, NULL);
-    semctl(semid, 0, IPC_RMID);
     
     return 0;
 }
\ No newline at end of file
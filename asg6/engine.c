@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "restaurant.h"
+#include "custfile.h"
+#include "actors.h"
+
+// Single-process engine: the restaurant of cook, waiter and customer with
+// every cook, waiter, customer and supervisor, and customer's door, run as
+// an actor on one discrete-event scheduler, in virtual time, without fork
+// or semop.
+//
+// The actors are the ones the three programs run (actors.c), and the
+// scheduler makes the moves sync.c makes in virtual time: one actor runs
+// at a time, an actor woken by a signal or added queues behind those
+// already ready, and once none is ready the earliest sleeper wakes and
+// moves the clock. The semaphores are counts with a FIFO of the actors
+// blocked on each. The restaurant is the usual layout (shm_init()) in
+// private memory, so the traces and the end of day report are those of a
+// virtual time run of the three programs; make check compares them.
+//
+//   engine [cook options] [customer list [cook trace waiter trace customer trace]]
+// Takes cook's options (see config_parse()) except -v, which is implied,
+// and -a and -s, which only apply to real time; and the list customer
+// would read, customers.txt by default. There is no worker pool (customer
+// -p). Given three trace files it writes each program's trace to its own;
+// otherwise all three go to stdout, interleaved in simulated order. The
+// end of day report goes to stderr.
+
+enum actor_kind {
+    ACTOR_COOK,
+    ACTOR_WAITER,
+    ACTOR_CUSTOMER,
+    ACTOR_DOOR,                 // customer's main process: the arrivals
+    ACTOR_SUPERVISOR,
+};
+
+struct actor {
+    int kind;
+    struct actor *next;         // in the run queue or a semaphore's queue
+    struct actor *older;        // every actor, in the order they were added
+    struct actor *newer;
+    union {
+        struct cook cook;
+        struct waiter waiter;
+        struct customer customer;
+        struct door door;
+        struct supervisor supervisor;
+    } u;
+};
+
+struct engine_sem {
+    int count;
+    struct actor *head;     // blocked actors, woken in order
+    struct actor *tail;
+};
+
+// A queued wake-up; due at the same time, they fire in FIFO order
+struct timer {
+    int time;
+    long long seq;
+    struct actor *actor;
+};
+
+static struct restaurant_shm *shm;
+static struct actor_env env;
+static FILE *trace[LOG_RINGS];
+static struct engine_sem *sems;         // NUM_SEMS
+static struct actor *run_head;
+static struct actor *run_tail;
+static struct actor *oldest;
+static struct actor *newest;
+static struct timer *timers;            // min-heap on (time, seq)
+static int ntimers;
+static int timer_cap;
+static long long timer_seq;
+static int door_opened;
+static int door_closed;                 // every customer has left
+static struct custfile customers;
+
+static void *engine_alloc(size_t size) {
+    void *p = calloc(1, size);
+    if (p == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+    return p;
+}
+
+// Scheduler
+
+static void make_ready(struct actor *a) {
+    a->next = NULL;
+    if (run_tail != NULL) run_tail->next = a;
+    else run_head = a;
+    run_tail = a;
+}
+
+// Take the semaphore, or queue the actor on it to be made ready with it
+// taken. Returns 1 if taken now.
+static int sem_take(struct actor *a, int sem_num) {
+    struct engine_sem *s = &sems[sem_num];
+    if (s->count > 0) {
+        s->count--;
+        return 1;
+    }
+    a->next = NULL;
+    if (s->tail != NULL) s->tail->next = a;
+    else s->head = a;
+    s->tail = a;
+    return 0;
+}
+
+// Hand the count to the first actor blocked on it, or keep it
+static void sem_give(int sem_num) {
+    struct engine_sem *s = &sems[sem_num];
+    struct actor *a = s->head;
+    if (a == NULL) {
+        s->count++;
+        return;
+    }
+    s->head = a->next;
+    if (s->head == NULL) s->tail = NULL;
+    make_ready(a);
+}
+
+static int timer_before(const struct timer *a, const struct timer *b) {
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void sleep_until(struct actor *a, int time) {
+    if (ntimers == timer_cap) {
+        timer_cap = timer_cap ? 2 * timer_cap : 64;
+        timers = realloc(timers, timer_cap * sizeof(struct timer));
+        if (timers == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    struct timer t = {time, timer_seq++, a};
+    int i = ntimers++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!timer_before(&t, &timers[parent])) break;
+        timers[i] = timers[parent];
+        i = parent;
+    }
+    timers[i] = t;
+}
+
+static struct timer timer_pop(void) {
+    struct timer top = timers[0];
+    struct timer last = timers[--ntimers];
+    int i = 0;
+    while (2 * i + 1 < ntimers) {
+        int child = 2 * i + 1;
+        if (child + 1 < ntimers && timer_before(&timers[child + 1], &timers[child])) child++;
+        if (!timer_before(&timers[child], &last)) break;
+        timers[i] = timers[child];
+        i = child;
+    }
+    timers[i] = last;
+    return top;
+}
+
+// The actors' semaphore operations. Within a step an actor only waits on
+// locks, which nobody holds between steps, so such a wait never blocks.
+static int engine_wait(int semid, int sem_num) {
+    if (sems[sem_num].count == 0) {
+        fprintf(stderr, "engine: semaphore %d held between steps\n", sem_num);
+        exit(1);
+    }
+    sems[sem_num].count--;
+    return 0;
+}
+
+static int engine_trywait(int semid, int sem_num) {
+    if (sems[sem_num].count == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    sems[sem_num].count--;
+    return 0;
+}
+
+static int engine_signal(int semid, int sem_num) {
+    sem_give(sem_num);
+    return 0;
+}
+
+static int engine_signal_many(int semid, const int *sem_nums, int n) {
+    for (int i = 0; i < n; i++) {
+        sem_give(sem_nums[i]);
+    }
+    return 0;
+}
+
+static const struct actor_ops engine_ops = {engine_wait, engine_trywait, engine_signal, engine_signal_many};
+
+// A new actor, ready to run, as sync_actor_add()
+static struct actor *add(int kind) {
+    struct actor *a = engine_alloc(sizeof(struct actor));
+    a->kind = kind;
+    a->older = newest;
+    if (newest != NULL) newest->newer = a;
+    else oldest = a;
+    newest = a;
+    make_ready(a);
+    return a;
+}
+
+static void remove_actor(struct actor *a) {
+    if (a->older != NULL) a->older->newer = a->newer;
+    else oldest = a->newer;
+    if (a->newer != NULL) a->newer->older = a->older;
+    else newest = a->older;
+    if (a->kind == ACTOR_COOK) free(a->u.cook.batch);
+    free(a);
+}
+
+// Start a cook or waiter, for main() and the supervisors, as spawn_cook()
+// and spawn_waiter() do
+static void hire_cook(int cook_id) {
+    COOK_STATS(shm, cook_id)->on_duty = 1;
+    cook_init(&add(ACTOR_COOK)->u.cook, &env, cook_id);
+}
+
+static void hire_waiter(int waiter_id) {
+    WAITER_STATS(shm, waiter_id)->on_duty = 1;
+    waiter_init(&add(ACTOR_WAITER)->u.waiter, &env, waiter_id);
+}
+
+// The door lets a customer in, as customer.c's admit() without a pool
+static void admit(struct door *door, const struct customer_record *record) {
+    customer_init(&add(ACTOR_CUSTOMER)->u.customer, &env, record);
+    door->started++;
+}
+
+// One step of an actor, its trace going to its program's
+static struct act step(struct actor *a) {
+    switch (a->kind) {
+    case ACTOR_COOK:
+        log_attach(NULL, LOG_COOK);
+        return cook_step(&a->u.cook);
+    case ACTOR_WAITER:
+        log_attach(NULL, LOG_WAITER);
+        return waiter_step(&a->u.waiter);
+    case ACTOR_CUSTOMER:
+        log_attach(NULL, LOG_CUSTOMER);
+        return customer_step(&a->u.customer);
+    case ACTOR_DOOR:
+        log_attach(NULL, LOG_CUSTOMER);
+        // customer's main opens at the start of its first turn
+        if (!door_opened) {
+            restaurant_open(&env);
+            door_opened = 1;
+        }
+        return door_step(&a->u.door);
+    default:
+        log_attach(NULL, a->u.supervisor.pool == 0 ? LOG_COOK : LOG_WAITER);
+        return supervisor_step(&a->u.supervisor);
+    }
+}
+
+// An actor has finished: a customer tells the door, as its process does
+static void finish(struct actor *a) {
+    if (a->kind == ACTOR_CUSTOMER) sem_give(CUSTOMER_DONE);
+    if (a->kind == ACTOR_DOOR) door_closed = 1;
+    remove_actor(a);
+}
+
+// Run until the door has seen the last customer leave, then end the day
+// the way sync_remove() does: the actors still there go in the order they
+// were added, each cook and waiter printing its leaving line
+static void run(void) {
+    while (!door_closed) {
+        struct actor *a = run_head;
+        if (a != NULL) {
+            run_head = a->next;
+            if (run_head == NULL) run_tail = NULL;
+        } else if (ntimers > 0) {
+            struct timer t = timer_pop();
+            clock_advance(shm, t.time);
+            a = t.actor;
+        } else {
+            fprintf(stderr, "engine: every actor is waiting and none is asleep\n");
+            exit(1);
+        }
+
+        // Its turn lasts until it blocks, sleeps or finishes
+        while (1) {
+            struct act act = step(a);
+            if (act.kind == ACT_DONE) {
+                finish(a);
+                break;
+            }
+            if (act.kind == ACT_SLEEP) {
+                sleep_until(a, act.until);
+                break;
+            }
+            if (!sem_take(a, act.sem)) break;
+        }
+    }
+
+    while (oldest != NULL) {
+        struct actor *a = oldest;
+        if (a->kind == ACTOR_COOK) {
+            log_attach(NULL, LOG_COOK);
+            cook_leaving(&a->u.cook);
+        } else if (a->kind == ACTOR_WAITER) {
+            log_attach(NULL, LOG_WAITER);
+            waiter_leaving(&a->u.waiter, 1);
+        }
+        remove_actor(a);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // Restaurant size and options, see restaurant.c for the flags; those
+    // for real time are refused rather than ignored
+    int opt;
+    opterr = 0;
+    while ((opt = getopt(argc, argv, CONFIG_OPTIONS)) != -1) {
+        if (opt == 'v' || opt == 'a' || opt == 's') {
+            fprintf(stderr, "%s: -%c does not apply, the engine always runs in virtual time\n", argv[0], opt);
+            exit(1);
+        }
+    }
+    opterr = 1;
+    optind = 1;
+    config_parse(argc, argv);
+    config.virtual_time = 1;
+    const char *customers_path = "customers.txt";
+    if (optind < argc) customers_path = argv[optind++];
+    if (argc - optind == LOG_RINGS) {
+        for (int r = 0; r < LOG_RINGS; r++) {
+            trace[r] = fopen(argv[optind + r], "w");
+            if (trace[r] == NULL) {
+                perror(argv[optind + r]);
+                exit(1);
+            }
+        }
+    } else if (argc == optind) {
+        for (int r = 0; r < LOG_RINGS; r++) trace[r] = stdout;
+    } else {
+        fprintf(stderr, "Usage: %s [cook options] [customer list [cook trace waiter trace customer trace]]\n",
+                argv[0]);
+        exit(1);
+    }
+    log_direct(trace);
+
+    // The usual layout, in private memory
+    size_t size = shm_size();
+    shm = aligned_alloc(CACHE_LINE, (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+    if (shm == NULL) {
+        perror("aligned_alloc");
+        exit(1);
+    }
+    shm_init(shm);
+    env = (struct actor_env){shm, -1, &engine_ops};
+
+    // The semaphores as cook sets them: the locks free, the dispatch queue
+    // empty and every event count 0
+    sems = engine_alloc(NUM_SEMS * sizeof(struct engine_sem));
+    sems[MUTEX].count = 1;
+    sems[TABLE_LOCK].count = 1;
+    sems[COOK_QUEUE_LOCK].count = 1;
+    sems[DISPATCH_LOCK].count = 1;
+    for (int i = 0; i < config.max_waiters; i++) {
+        sems[WAITER_QUEUE_LOCK(i)].count = 1;
+    }
+    sems[DISPATCH_SPACE].count = DISPATCH_CAPACITY;
+
+    if (custfile_open(&customers, customers_path) == -1) {
+        perror(customers_path);
+        exit(1);
+    }
+
+    struct timespec opened, closed;
+    clock_gettime(CLOCK_MONOTONIC, &opened);
+
+    // Everyone starts at 11:00am in the order the programs start them in
+    struct supervisor *sup;
+    for (int i = 0; i < config.cooks; i++) {
+        hire_cook(i);
+    }
+    if (config.max_cooks > config.cooks) {
+        sup = &add(ACTOR_SUPERVISOR)->u.supervisor;
+        supervisor_init(sup, &env, 0, hire_cook);
+    }
+    for (int i = 0; i < config.waiters; i++) {
+        hire_waiter(i);
+    }
+    if (config.max_waiters > config.waiters) {
+        sup = &add(ACTOR_SUPERVISOR)->u.supervisor;
+        supervisor_init(sup, &env, 1, hire_waiter);
+    }
+    struct door *door = &add(ACTOR_DOOR)->u.door;
+    door_init(door, &env, &customers);
+    door->admit = admit;
+
+    run();
+
+    custfile_close(&customers);
+    clock_gettime(CLOCK_MONOTONIC, &closed);
+    for (int r = 0; r < LOG_RINGS; r++) {
+        if (trace[r] != stdout) fclose(trace[r]);
+    }
+    fflush(stdout);
+    stats_report(shm, -1, stderr);
+    double seconds = (closed.tv_sec - opened.tv_sec) + (closed.tv_nsec - opened.tv_nsec) / 1e9;
+    fprintf(stderr, "engine: %.3f s, %.0f customers served per second\n", seconds,
+            seconds > 0 ? shm->stats.customer_wait.count / seconds : 0.0);
+
+    free(timers);
+    free(sems);
+    free(shm);
+    return 0;
+}
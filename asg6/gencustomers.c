@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "custfile.h"
+
+// Customer list generator, writes customers.txt (or a binary list) to stdout.
+//
+// Arrival patterns:
+//   poisson  exponential gaps at a constant rate
+//   bursty   the rate switches between 4x and 1/4 of the mean, in spells
+//   lunch    the rate peaks around 12:30pm and is low at the edges
+// Group sizes are drawn from 1..max:
+//   uniform  every size equally likely
+//   small    mostly singles and couples (geometric)
+//   large    mostly full tables (geometric from the top)
+//
+// The same seed and options always give the same list.
+
+static const char *usage =
+    "Usage: %s [-n customers] [-a poisson|bursty|lunch] [-r customers per minute]\n"
+    "          [-g uniform|small|large] [-m max group size] [-s seed] [-b]\n";
+
+// xorshift64*, so that the output does not depend on the C library
+static unsigned long long rng_state;
+
+static unsigned long long rng_next(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+// Uniform in (0, 1]
+static double rng_uniform(void) {
+    return ((rng_next() >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_exponential(double rate) {
+    return -log(rng_uniform()) / rate;
+}
+
+// Customers per minute at time t (minutes after 11:00am) for the lunch rush
+static double lunch_rate(double mean, double t) {
+    double x = (t - 90) / 45;
+    return mean * (0.3 + 1.7 * exp(-x * x));
+}
+
+#define LUNCH_PEAK 2.0      // lunch_rate() never exceeds mean * LUNCH_PEAK
+
+static int group_size(const char *groups, int max) {
+    if (strcmp(groups, "uniform") == 0) {
+        return 1 + rng_next() % max;
+    }
+    int n = 1;
+    while (n < max && rng_uniform() <= 0.5) n++;
+    return strcmp(groups, "large") == 0 ? max + 1 - n : n;
+}
+
+int main(int argc, char *argv[]) {
+    long long count = 64;
+    const char *arrivals = "poisson";
+    double rate = 0.25;
+    const char *groups = "uniform";
+    int max_group = 4;
+    unsigned long long seed = 1;
+    int binary = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:a:r:g:m:s:b")) != -1) {
+        switch (opt) {
+        case 'n': count = atoll(optarg); break;
+        case 'a': arrivals = optarg; break;
+        case 'r': rate = atof(optarg); break;
+        case 'g': groups = optarg; break;
+        case 'm': max_group = atoi(optarg); break;
+        case 's': seed = strtoull(optarg, NULL, 0); break;
+        case 'b': binary = 1; break;
+        default:
+            fprintf(stderr, usage, argv[0]);
+            exit(1);
+        }
+    }
+    if (count < 0 || count > 0x7fffffff || rate <= 0 || max_group < 1 ||
+        (strcmp(arrivals, "poisson") != 0 && strcmp(arrivals, "bursty") != 0 &&
+         strcmp(arrivals, "lunch") != 0) ||
+        (strcmp(groups, "uniform") != 0 && strcmp(groups, "small") != 0 &&
+         strcmp(groups, "large") != 0)) {
+        fprintf(stderr, usage, argv[0]);
+        exit(1);
+    }
+    if (binary && isatty(STDOUT_FILENO)) {
+        fprintf(stderr, "%s: not writing a binary list to a terminal\n", argv[0]);
+        exit(1);
+    }
+    rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;   // never 0
+
+    if (binary) {
+        struct custfile_header header = {CUSTFILE_MAGIC, CUSTFILE_VERSION, count};
+        fwrite(&header, sizeof(header), 1, stdout);
+    }
+
+    double t = 0;
+    int busy_spell = 0;     // bursty: currently in a busy spell
+    for (long long i = 1; i <= count; i++) {
+        if (strcmp(arrivals, "poisson") == 0) {
+            t += rng_exponential(rate);
+        } else if (strcmp(arrivals, "bursty") == 0) {
+            // A spell lasts 10 arrivals on average
+            if (rng_uniform() <= 0.1) busy_spell = !busy_spell;
+            t += rng_exponential(busy_spell ? rate * 4 : rate / 4);
+        } else {
+            // Thinning: draw at the peak rate, keep in proportion to the rate at t
+            do {
+                t += rng_exponential(rate * LUNCH_PEAK);
+            } while (rng_uniform() * rate * LUNCH_PEAK > lunch_rate(rate, t));
+        }
+
+        struct customer_record record;
+        record.customer_id = (int)i;
+        record.arrival_time = t > 0x7fffffff ? 0x7fffffff : (int)t;
+        record.count = group_size(groups, max_group);
+        if (binary) {
+            fwrite(&record, sizeof(record), 1, stdout);
+        } else {
+            printf("%d %d %d\n", record.customer_id, record.arrival_time, record.count);
+        }
+    }
+    if (!binary) printf("-1\n");
+
+    if (fflush(stdout) == EOF) {
+        perror("stdout");
+        exit(1);
+    }
+    return 0;
+}
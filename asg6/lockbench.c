@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "sync.h"
+
+// Contention benchmark for the restaurant locks.
+//
+// A synthetic model, not the restaurant itself: it has its own semaphore
+// set and an array of int counters laid out as the shared segment was
+// before struct restaurant_shm, and does not follow restaurant.h. It
+// forks customer-, waiter- and cook-like processes that run critical
+// sections modelled on those of customer.c, waiter.c and cook.c back to
+// back with no sleeping: take a table, push to a waiter queue, pop it,
+// push to the cook queue, pop it, bump the clock and print a line. Every
+// run is done twice, once with all sections under one mutex (the
+// SINGLE_MUTEX build) and once with the split locks, and the throughput
+// of each is reported. The model shows what splitting the locks gains,
+// not the figures of the programs as they are now.
+// lockbench uses the default futex-backed semaphores and lockbench-sysv
+// the -DSYNC_SYSV ones, so the two backends can be compared as well.
+//
+// A second table times the waiter's order handoff (unlock the cook queue,
+// wake a cook, wake the customer) done as three signals and coalesced
+// into one sync_signal_many(), with the system calls made per handoff:
+// the semop() calls in lockbench-sysv, an estimate from the waits that
+// slept in lockbench, see sync_syscalls().
+//
+// Usage: ./lockbench [-p processes per role] [-n iterations per process]
+
+#define NUM_WAITERS 5
+
+// Semaphore indices of the model (roles as in restaurant.h, not its numbers)
+#define MUTEX 0
+#define TABLE_LOCK 1
+#define COOK_QUEUE_LOCK 2
+#define WAITER_QUEUE_LOCK 3     // 3..7
+#define START_SEM 8             // releases all workers at once
+#define ORDER_SEM 9             // handoff: orders for the cooks
+#define CUSTOMER_WAKE 10        // handoff: order placed, for the customers
+#define NUM_SEMS 11
+
+// Shared counters of the model, in the old int array layout
+#define TIME_INDEX 0
+#define EMPTY_TABLES_INDEX 1
+#define NEXT_WAITER_INDEX 2
+#define PENDING_ORDERS_INDEX 3
+#define WAITER_PO_INDEX 4       // 4..8
+#define SYSCALLS_INDEX 9        // handoff: system calls of all workers
+#define SHM_SIZE 16
+#define SYNC_AREA_OFFSET (SHM_SIZE * sizeof(int))
+
+int semid;
+int *shm;
+int lock_map[NUM_SEMS];     // logical lock -> semaphore actually used
+
+void lock(int l) {
+    if (sync_wait(semid, lock_map[l]) == -1) {
+        perror("semop lock");
+        exit(1);
+    }
+}
+
+void unlock(int l) {
+    if (sync_signal(semid, lock_map[l]) == -1) {
+        perror("semop unlock");
+        exit(1);
+    }
+}
+
+// Stand-in for the print_time() + printf() done under MUTEX
+void fake_print(int t, int id) {
+    char line[128];
+    snprintf(line, sizeof(line), "[%d:%02d] Actor %d: did something\n", 11 + t / 60, t % 60, id);
+}
+
+void clock_tick(int id) {
+    lock(MUTEX);
+    shm[TIME_INDEX]++;
+    fake_print(shm[TIME_INDEX], id);
+    unlock(MUTEX);
+}
+
+void customer_role(int id, int iterations) {
+    for (int i = 0; i < iterations; i++) {
+        lock(TABLE_LOCK);
+        shm[EMPTY_TABLES_INDEX]--;
+        int waiter_id = shm[NEXT_WAITER_INDEX];
+        shm[NEXT_WAITER_INDEX] = (waiter_id + 1) % NUM_WAITERS;
+        unlock(TABLE_LOCK);
+
+        lock(WAITER_QUEUE_LOCK + waiter_id);
+        shm[WAITER_PO_INDEX + waiter_id]++;
+        unlock(WAITER_QUEUE_LOCK + waiter_id);
+
+        clock_tick(id);
+
+        lock(TABLE_LOCK);
+        shm[EMPTY_TABLES_INDEX]++;
+        unlock(TABLE_LOCK);
+    }
+}
+
+void waiter_role(int id, int iterations) {
+    int waiter_id = id % NUM_WAITERS;
+    for (int i = 0; i < iterations; i++) {
+        lock(WAITER_QUEUE_LOCK + waiter_id);
+        shm[WAITER_PO_INDEX + waiter_id]--;
+        unlock(WAITER_QUEUE_LOCK + waiter_id);
+
+        clock_tick(id);
+
+        lock(COOK_QUEUE_LOCK);
+        shm[PENDING_ORDERS_INDEX]++;
+        unlock(COOK_QUEUE_LOCK);
+    }
+}
+
+void cook_role(int id, int iterations) {
+    for (int i = 0; i < iterations; i++) {
+        lock(COOK_QUEUE_LOCK);
+        shm[PENDING_ORDERS_INDEX]--;
+        unlock(COOK_QUEUE_LOCK);
+
+        clock_tick(id);
+    }
+}
+
+void post(int sem_num) {
+    if (sync_signal(semid, sem_num) == -1) {
+        perror("semop signal");
+        exit(1);
+    }
+}
+
+void handoff_waiter(int coalesced, int iterations) {
+    for (int i = 0; i < iterations; i++) {
+        lock(COOK_QUEUE_LOCK);
+        shm[PENDING_ORDERS_INDEX]++;
+        if (coalesced) {
+            if (sync_signal_many(semid, (int[]){COOK_QUEUE_LOCK, ORDER_SEM, CUSTOMER_WAKE}, 3) == -1) {
+                perror("semop signal");
+                exit(1);
+            }
+        } else {
+            unlock(COOK_QUEUE_LOCK);
+            post(ORDER_SEM);
+            post(CUSTOMER_WAKE);
+        }
+    }
+}
+
+void handoff_cook(int iterations) {
+    for (int i = 0; i < iterations; i++) {
+        lock(ORDER_SEM);
+        lock(COOK_QUEUE_LOCK);
+        shm[PENDING_ORDERS_INDEX]--;
+        unlock(COOK_QUEUE_LOCK);
+    }
+}
+
+void handoff_customer(int iterations) {
+    for (int i = 0; i < iterations; i++) {
+        lock(CUSTOMER_WAKE);
+    }
+}
+
+// Time the order handoff, returns handoffs per second
+double handoff(int coalesced, int procs, int iterations) {
+    for (int i = 0; i < NUM_SEMS; i++) {
+        lock_map[i] = i;
+        int val = (i == MUTEX || i == TABLE_LOCK || i == COOK_QUEUE_LOCK ||
+                   (i >= WAITER_QUEUE_LOCK && i < WAITER_QUEUE_LOCK + NUM_WAITERS));
+        if (sync_setval(semid, i, val) == -1) {
+            perror("sync_setval");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < SHM_SIZE; i++) shm[i] = 0;
+
+    int total = 3 * procs;
+    fflush(stdout);
+    for (int p = 0; p < total; p++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            exit(1);
+        } else if (pid == 0) {
+            sync_wait(semid, START_SEM);
+            unsigned long start = sync_syscalls();
+            if (p % 3 == 0) handoff_waiter(coalesced, iterations);
+            else if (p % 3 == 1) handoff_cook(iterations);
+            else handoff_customer(iterations);
+            __atomic_fetch_add(&shm[SYSCALLS_INDEX], (int)(sync_syscalls() - start), __ATOMIC_RELAXED);
+            exit(0);
+        }
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int p = 0; p < total; p++) sync_signal(semid, START_SEM);
+    while (wait(NULL) > 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double handoffs = (double)procs * iterations;
+    printf("%-9s %6d %10.0f %9.3f %12.0f %9.2f\n", coalesced ? "coalesced" : "separate",
+           total, handoffs, seconds, handoffs / seconds, shm[SYSCALLS_INDEX] / handoffs);
+    return handoffs / seconds;
+}
+
+// Run one configuration, returns operations (critical sections) per second
+double run(int single_mutex, int procs, int iterations) {
+    for (int i = 0; i < NUM_SEMS; i++) {
+        lock_map[i] = (single_mutex && i != START_SEM) ? MUTEX : i;
+        if (sync_setval(semid, i, (i == START_SEM) ? 0 : 1) == -1) {
+            perror("sync_setval");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < SHM_SIZE; i++) shm[i] = 0;
+
+    int total = 3 * procs;
+    fflush(stdout);
+    for (int p = 0; p < total; p++) {
+        pid_t pid = fork();
+        if (pid == -1) {
+            perror("fork");
+            exit(1);
+        } else if (pid == 0) {
+            sync_wait(semid, START_SEM);
+            if (p % 3 == 0) customer_role(p, iterations);
+            else if (p % 3 == 1) waiter_role(p, iterations);
+            else cook_role(p, iterations);
+            exit(0);
+        }
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int p = 0; p < total; p++) sync_signal(semid, START_SEM);
+    while (wait(NULL) > 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    // customers do 4 sections, waiters 3, cooks 2 per iteration
+    double ops = (double)procs * iterations * (4 + 3 + 2);
+    printf("%-8s %6d %10.0f %9.3f %12.0f\n", single_mutex ? "single" : "split",
+           total, ops, seconds, ops / seconds);
+    return ops / seconds;
+}
+
+int main(int argc, char *argv[]) {
+    int procs = 4;
+    int iterations = 20000;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:n:")) != -1) {
+        if (opt == 'p') procs = atoi(optarg);
+        else if (opt == 'n') iterations = atoi(optarg);
+        else {
+            fprintf(stderr, "Usage: %s [-p processes per role] [-n iterations]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    int shmid = shmget(IPC_PRIVATE, SYNC_AREA_OFFSET + sync_area_size(NUM_SEMS), IPC_CREAT | 0600);
+    if (shmid == -1) {
+        perror("shmget");
+        exit(1);
+    }
+    shm = (int *)shmat(shmid, NULL, 0);
+    if (shm == (int *)-1) {
+        perror("shmat");
+        exit(1);
+    }
+    semid = sync_create(IPC_PRIVATE, (char *)shm + SYNC_AREA_OFFSET, NUM_SEMS);
+    if (semid == -1) {
+        perror("sync_create");
+        exit(1);
+    }
+
+    printf("%-8s %6s %10s %9s %12s\n", "locks", "procs", "ops", "seconds", "ops/sec");
+    double single = run(1, procs, iterations);
+    double split = run(0, procs, iterations);
+    printf("split/single throughput: %.2fx\n", split / single);
+
+    printf("\n%-9s %6s %10s %9s %12s %9s\n", "handoff", "procs", "handoffs", "seconds", "handoffs/sec", "syscalls");
+    double separate = handoff(0, procs, iterations);
+    double coalesced = handoff(1, procs, iterations);
+    printf("coalesced/separate throughput: %.2fx\n", coalesced / separate);
+
+    sync_remove(semid);
+    shmdt(shm);
+    shmctl(shmid, IPC_RMID, NULL);
+    return 0;
+}
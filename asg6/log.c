@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "restaurant.h"
+#include "log.h"
+
+// Each ring is a bounded multi-producer queue. A slot's seq says which
+// ring position it is ready for: seq == pos means the slot is free for the
+// producer that reserved position pos, seq == pos + 1 means the record
+// for pos is complete. Producers reserve positions with an atomic add on
+// tail, the drainer is the only reader and advances head.
+//
+// The drainer sleeps on the ring's wake semaphore when it finds the ring
+// empty. It sets sleeping before it looks at the slot a last time, and a
+// producer looks at sleeping after it has completed its record, each
+// behind a full fence, so at least one of them sees the other. Whoever
+// clears sleeping decides: the producer posts wake, the drainer does not
+// wait.
+
+#define LOG_MASK (LOG_CAPACITY - 1)
+
+static struct log_ring *log_ring;   // ring of this process
+static int log_ring_index;
+static FILE **log_files;            // see log_direct()
+
+void log_init(void *area) {
+    struct log_ring *rings = area;
+    for (int r = 0; r < LOG_RINGS; r++) {
+        rings[r].tail = 0;
+        rings[r].head = 0;
+        rings[r].sleeping = 0;
+        sem_init(&rings[r].wake, 1, 0);
+        for (int i = 0; i < LOG_CAPACITY; i++) {
+            rings[r].slots[i].seq = i;
+        }
+    }
+}
+
+void log_attach(void *area, int ring) {
+    log_ring = area != NULL ? (struct log_ring *)area + ring : NULL;
+    log_ring_index = ring;
+}
+
+void log_direct(FILE *files[LOG_RINGS]) {
+    log_files = files;
+}
+
+static void log_format(FILE *fp, const struct log_record *r);
+
+void log_put(int event, int time, int actor, int customer_id, int a, int b) {
+    if (log_files != NULL) {
+        struct log_record r = {0, event, actor, time, customer_id, a, b};
+        log_format(log_files[log_ring_index], &r);
+        return;
+    }
+    unsigned int pos = __atomic_fetch_add(&log_ring->tail, 1, __ATOMIC_RELAXED);
+    struct log_record *slot = &log_ring->slots[pos & LOG_MASK];
+    // Only waits if the drainer is a whole ring behind
+    while (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos) {
+        sched_yield();
+    }
+    slot->event = event;
+    slot->actor = actor;
+    slot->time = time;
+    slot->customer_id = customer_id;
+    slot->a = a;
+    slot->b = b;
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+    // Wake the drainer if it is asleep on an empty ring
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&log_ring->sleeping, __ATOMIC_RELAXED) &&
+        __atomic_exchange_n(&log_ring->sleeping, 0, __ATOMIC_ACQ_REL)) {
+        sem_post(&log_ring->wake);
+    }
+}
+
+// Print a record the way the programs used to print it
+static void log_format(FILE *fp, const struct log_record *r) {
+    if (r->time >= 0) fprint_time(fp, r->time);
+    switch (r->event) {
+    case LOG_COOK_READY:
+        fprintf(fp, "%sCook %s is ready\n", cook_indent(r->actor), cook_name(r->actor));
+        break;
+    case LOG_COOK_PREPARING:
+    case LOG_COOK_PREPARED:
+        fprintf(fp, "%sCook %s: %s order (Waiter %s, Customer %d, Count %d)\n",
+               cook_indent(r->actor), cook_name(r->actor),
+               r->event == LOG_COOK_PREPARING ? "Preparing" : "Prepared",
+               waiter_name(r->a), r->customer_id, r->b);
+        break;
+    case LOG_COOK_LEAVING:
+        if (r->a) fprintf(fp, "Cook %s:Leaving\n", cook_name(r->actor));
+        break;
+    case LOG_COOK_SENT_HOME:
+        fprintf(fp, "%sCook %s: No orders, sent home\n", cook_indent(r->actor), cook_name(r->actor));
+        break;
+    case LOG_WAITER_READY:
+        fprintf(fp, "%sWaiter %s is ready\n", waiter_indent(r->actor), waiter_name(r->actor));
+        break;
+    case LOG_WAITER_SHIFT_ENDING:
+        fprintf(fp, "%sWaiter %s: Time is after 3:00pm, no pending orders, shift ending\n",
+               waiter_indent(r->actor), waiter_name(r->actor));
+        break;
+    case LOG_WAITER_SERVING:
+        fprintf(fp, "%sWaiter %s: Serving food to customer %d\n",
+               waiter_indent(r->actor), waiter_name(r->actor), r->customer_id);
+        break;
+    case LOG_WAITER_PLACED:
+        fprintf(fp, "%sWaiter %s: Placed order for customer %d\n",
+               waiter_indent(r->actor), waiter_name(r->actor), r->customer_id);
+        break;
+    case LOG_WAITER_SHIFT_ENDED:
+        fprintf(fp, "%sWaiter %s: Shift ended\n", waiter_indent(r->actor), waiter_name(r->actor));
+        break;
+    case LOG_WAITER_LEAVING:
+        fprintf(fp, "Waiter %s: Leaving (no more customer to serve)%s\n",
+               waiter_name(r->actor), r->a ? ")" : "");
+        break;
+    case LOG_WAITER_SENT_HOME:
+        fprintf(fp, "%sWaiter %s: No customers, sent home\n", waiter_indent(r->actor), waiter_name(r->actor));
+        break;
+    case LOG_CUSTOMER_LATE:
+        fprintf(fp, " \t\t\t\tCustomer %d leaves (late arrival)\n", r->customer_id);
+        break;
+    case LOG_CUSTOMER_NO_TABLE:
+        fprintf(fp, " \t\t\t\tCustomer %d leaves (no empty table)\n", r->customer_id);
+        break;
+    case LOG_CUSTOMER_OVERLOADED:
+        fprintf(fp, " \t\t\t\tCustomer %d leaves (waiter %s is overloaded)\n",
+               r->customer_id, waiter_name(r->a));
+        break;
+    case LOG_CUSTOMER_ARRIVES:
+        fprintf(fp, " Customer %d arrives (count = %d)\n", r->customer_id, r->b);
+        break;
+    case LOG_CUSTOMER_ORDER_PLACED:
+        fprintf(fp, "   Customer %d: Order placed to waiter %s\n", r->customer_id, waiter_name(r->a));
+        break;
+    case LOG_CUSTOMER_GETS_FOOD:
+        fprintf(fp, " \t  Customer %d: gets food [waiting time = %d]\n", r->customer_id, r->b);
+        break;
+    case LOG_CUSTOMER_FINISHED:
+        fprintf(fp, " \t\t  Customer %d: Finished eating, leaving (%d tables available)\n",
+               r->customer_id, r->b);
+        break;
+    }
+}
+
+// Drainer: print records in ring order until the stop record
+static void drain(void) {
+    while (1) {
+        unsigned int pos = log_ring->head;
+        struct log_record *slot = &log_ring->slots[pos & LOG_MASK];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+            // Empty: write out what we have and sleep until a producer
+            // wakes us, unless a record came in after all (see above)
+            fflush(stdout);
+            __atomic_store_n(&log_ring->sleeping, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == pos + 1 &&
+                __atomic_exchange_n(&log_ring->sleeping, 0, __ATOMIC_ACQ_REL)) {
+                continue;
+            }
+            while (sem_wait(&log_ring->wake) == -1 && errno == EINTR);
+            continue;
+        }
+        struct log_record r = *slot;
+        __atomic_store_n(&slot->seq, pos + LOG_CAPACITY, __ATOMIC_RELEASE);
+        log_ring->head = pos + 1;
+
+        if (r.event == LOG_STOP) break;
+        log_format(stdout, &r);
+    }
+    fflush(stdout);
+    exit(0);
+}
+
+pid_t log_start_drainer(void) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork drainer");
+        exit(1);
+    } else if (pid == 0) {
+        drain();
+        // Never returns
+    }
+    return pid;
+}
+
+void log_stop(pid_t drainer) {
+    log_put(LOG_STOP, -1, 0, 0, 0, 0);
+    waitpid(drainer, NULL, 0);
+}
@@ -0,0 +1,89 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+#include <semaphore.h>
+#include <sys/types.h>
+
+// Trace output off the critical sections.
+//
+// Instead of printing, cooks, waiters and customers put fixed-size event
+// records into their program's log ring in the shared segment. Each of
+// cook, waiter and customer forks a drainer process that formats the
+// records and writes them to the program's stdout, so the output is the
+// same trace as before. A ring slot is reserved with one atomic add at
+// the point where the line used to be printed, which keeps the lines in
+// the order they were printed in, and no lock or system call is needed
+// unless the ring is full or the drainer has gone to sleep on an empty
+// ring, in which case the producer that finds it asleep wakes it.
+
+enum log_event {
+    LOG_COOK_READY,             // actor = cook
+    LOG_COOK_PREPARING,         // actor = cook, a = waiter, customer, b = count
+    LOG_COOK_PREPARED,          // same
+    LOG_COOK_LEAVING,           // a = 1: print the name, 0: only the time
+    LOG_COOK_SENT_HOME,         // actor = cook
+    LOG_WAITER_READY,           // actor = waiter
+    LOG_WAITER_SHIFT_ENDING,
+    LOG_WAITER_SERVING,         // customer
+    LOG_WAITER_PLACED,          // customer
+    LOG_WAITER_SHIFT_ENDED,
+    LOG_WAITER_LEAVING,         // time -1: no time, a = 1 if woken in a wait
+    LOG_WAITER_SENT_HOME,       // actor = waiter
+    LOG_CUSTOMER_LATE,          // customer
+    LOG_CUSTOMER_NO_TABLE,      // customer
+    LOG_CUSTOMER_OVERLOADED,    // customer, a = waiter
+    LOG_CUSTOMER_ARRIVES,       // customer, b = count
+    LOG_CUSTOMER_ORDER_PLACED,  // customer, a = waiter
+    LOG_CUSTOMER_GETS_FOOD,     // customer, b = waiting time
+    LOG_CUSTOMER_FINISHED,      // customer, b = tables available
+    LOG_STOP,                   // tells the drainer to finish
+};
+
+// Rings, one per program
+#define LOG_COOK 0
+#define LOG_WAITER 1
+#define LOG_CUSTOMER 2
+#define LOG_RINGS 3
+
+#define LOG_CAPACITY 4096       // records per ring, a power of two
+
+struct log_record {
+    unsigned int seq;       // ring position the slot is ready for, see log.c
+    short event;
+    short actor;
+    int time;
+    int customer_id;
+    int a;
+    int b;
+};
+
+struct log_ring {
+    unsigned int tail;      // next position to reserve, producers only
+    char pad1[60];
+    unsigned int head;      // next position to drain, drainer only
+    int sleeping;           // 1: the drainer waits, or is about to, on wake
+    sem_t wake;             // posted by the producer that clears sleeping
+    char pad2[64 - 2 * sizeof(int) - sizeof(sem_t)];
+    struct log_record slots[LOG_CAPACITY];
+};
+
+#define LOG_AREA_SIZE (LOG_RINGS * sizeof(struct log_ring))
+
+// Set up empty rings in a newly created segment (cook)
+void log_init(void *area);
+// Select the ring this process and its children write to
+void log_attach(void *area, int ring);
+// Fork the drainer for the selected ring
+pid_t log_start_drainer(void);
+// Once every writer has finished: let the drainer empty the ring and exit
+void log_stop(pid_t drainer);
+
+void log_put(int event, int time, int actor, int customer_id, int a, int b);
+
+// For the single-process engine, which has no drainers: from now on
+// log_put() prints each record straight to files[ring], ring as selected
+// by log_attach() (area is not used)
+void log_direct(FILE *files[LOG_RINGS]);
+
+#endif
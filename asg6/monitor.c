@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "restaurant.h"
+
+// Live view of the running restaurant: free tables, the cook backlog and
+// each waiter's queue, sampled without taking any lock. Every group of
+// fields is copied under its seqcount (see struct restaurant_shm), so each
+// group is consistent in itself and the cooks, waiters and customers never
+// wait for the monitor. The segment is attached read-only.
+//
+//   monitor [-i milliseconds] [-n samples] [-c]
+// Redraws a dashboard every -i milliseconds (default 100), or with -c
+// writes one CSV line per sample instead. Stops after -n samples, or when
+// the day is over.
+
+struct waiter_sample {
+    int po;
+    int food;
+    int retire;
+    int busy;
+    int incoming;
+};
+
+struct sample {
+    int time;
+    // tables
+    int empty;
+    int active_waiters;
+    // cook queue
+    int pending;
+    int cooking;
+    int cook_retire;
+    // from the statistics, updated atomically
+    long long served;
+    long long rejected;
+    struct waiter_sample *waiters;  // max_waiters
+};
+
+static long long retries;       // copies thrown away because a writer got in
+
+static void read_tables(struct restaurant_shm *shm, struct sample *s) {
+    while (1) {
+        unsigned int start = seq_read_begin(&shm->tables.seq);
+        s->empty = shm->tables.empty;
+        s->active_waiters = shm->tables.active_waiters;
+        if (!seq_read_retry(&shm->tables.seq, start)) break;
+        retries++;
+    }
+}
+
+static void read_cook_queue(struct restaurant_shm *shm, struct sample *s) {
+    while (1) {
+        unsigned int start = seq_read_begin(&shm->cook_queue.seq);
+        s->pending = shm->cook_queue.pending;
+        s->cooking = shm->cook_queue.cooking;
+        s->cook_retire = shm->cook_queue.retire;
+        if (!seq_read_retry(&shm->cook_queue.seq, start)) break;
+        retries++;
+    }
+}
+
+static void read_waiter(struct restaurant_shm *shm, int waiter_id, struct waiter_sample *w) {
+    struct waiter_area *area = WAITER_AREA(shm, waiter_id);
+    while (1) {
+        unsigned int start = seq_read_begin(&area->seq);
+        w->po = area->po;
+        w->food = area->food_tail - area->food_head;
+        w->retire = area->retire;
+        if (!seq_read_retry(&area->seq, start)) break;
+        retries++;
+    }
+    // Written outside the lock, atomically
+    w->busy = __atomic_load_n(&area->busy, __ATOMIC_RELAXED);
+    w->incoming = __atomic_load_n(&area->incoming, __ATOMIC_RELAXED);
+}
+
+static void take_sample(struct restaurant_shm *shm, struct sample *s) {
+    s->time = clock_now(shm);
+    read_tables(shm, s);
+    read_cook_queue(shm, s);
+    for (int i = 0; i < config.max_waiters; i++) {
+        read_waiter(shm, i, &s->waiters[i]);
+    }
+    s->served = __atomic_load_n(&shm->stats.customer_wait.count, __ATOMIC_RELAXED);
+    s->rejected = 0;
+    for (int r = 0; r < REJECT_REASONS; r++) {
+        s->rejected += __atomic_load_n(&shm->stats.rejected[r], __ATOMIC_RELAXED);
+    }
+}
+
+static void print_csv_header(void) {
+    printf("wall_ms,time,empty,active_waiters,pending,cooking,served,rejected");
+    for (int i = 0; i < config.max_waiters; i++) {
+        const char *name = waiter_name(i);
+        printf(",po_%s,food_%s,busy_%s", name, name, name);
+    }
+    printf("\n");
+}
+
+static void print_csv(const struct sample *s, double wall_ms) {
+    printf("%.1f,%d,%d,%d,%d,%d,%lld,%lld", wall_ms, s->time, s->empty, s->active_waiters,
+           s->pending, s->cooking, s->served, s->rejected);
+    for (int i = 0; i < config.max_waiters; i++) {
+        printf(",%d,%d,%d", s->waiters[i].po, s->waiters[i].food, s->waiters[i].busy);
+    }
+    printf("\n");
+}
+
+static void print_dashboard(const struct sample *s, long long samples) {
+    printf("\033[H\033[2J");
+    print_time(s->time);
+    printf("  %lld served, %lld turned away\n\n", s->served, s->rejected);
+
+    int used = config.tables - s->empty;
+    printf("tables  %3d/%-3d [", used, config.tables);
+    for (int i = 0; i < config.tables && i < 60; i++) putchar(i < used ? '#' : '.');
+    printf("%s]\n", config.tables > 60 ? "..." : "");
+    printf("cooks   %3d orders queued, %d being cooked", s->pending, s->cooking);
+    if (s->cook_retire > 0) printf(", %d sent home", s->cook_retire);
+    printf("\n\n");
+
+    printf("waiter  queued  food  busy\n");
+    for (int i = 0; i < config.max_waiters; i++) {
+        const struct waiter_sample *w = &s->waiters[i];
+        printf("%-6s  %6d  %4d  %4s", waiter_name(i), w->po, w->food, w->busy ? "yes" : "");
+        if (i >= s->active_waiters) printf("  (off duty)");
+        else if (w->incoming > 0) printf("  +%d arriving", w->incoming);
+        if (w->retire) printf("  sent home");
+        printf("\n");
+    }
+    printf("\n%lld samples, %lld retried\n", samples, retries);
+}
+
+int main(int argc, char *argv[]) {
+    double interval_ms = 100;
+    long long max_samples = 0;
+    int csv = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:n:c")) != -1) {
+        if (opt == 'i' && atof(optarg) >= 0) {
+            interval_ms = atof(optarg);
+        } else if (opt == 'n' && atoll(optarg) > 0) {
+            max_samples = atoll(optarg);
+        } else if (opt == 'c') {
+            csv = 1;
+        } else {
+            fprintf(stderr, "Usage: %s [-i milliseconds] [-n samples] [-c]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    // Create a key for shared memory (same as cook.c)
+    key_t key = ftok("./cook", 'R');
+    if (key == -1) {
+        perror("ftok");
+        exit(1);
+    }
+
+    // Get the shared memory segment
+    int shmid = shmget(key, 0, 0666);
+    if (shmid == -1) {
+        perror("shmget");
+        exit(1);
+    }
+
+    struct restaurant_shm *shm = shmat(shmid, NULL, SHM_RDONLY);
+    if (shm == (void *)-1) {
+        perror("shmat");
+        exit(1);
+    }
+
+    // Check that cook laid the segment out the way this build expects, and
+    // load the configuration from it
+    struct shmid_ds seg;
+    if (shmctl(shmid, IPC_STAT, &seg) == -1) {
+        perror("shmctl");
+        exit(1);
+    }
+    if (shm_validate(shm, seg.shm_segsz) == -1) {
+        fprintf(stderr, "%s: shared memory layout does not match, rebuild and restart cook\n", argv[0]);
+        exit(1);
+    }
+
+    struct sample s;
+    s.waiters = calloc(config.max_waiters, sizeof(struct waiter_sample));
+    if (s.waiters == NULL) {
+        perror("calloc");
+        exit(1);
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (csv) print_csv_header();
+    for (long long n = 1; max_samples == 0 || n <= max_samples; n++) {
+        take_sample(shm, &s);
+        if (csv) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            print_csv(&s, (now.tv_sec - start.tv_sec) * 1e3 + (now.tv_nsec - start.tv_nsec) / 1e6);
+        } else {
+            print_dashboard(&s, n);
+        }
+        fflush(stdout);
+
+        // customer removes the segment once the last customer has left
+        if (shmctl(shmid, IPC_STAT, &seg) == -1 || (seg.shm_perm.mode & SHM_DEST)) break;
+        if (interval_ms > 0) usleep((useconds_t)(interval_ms * 1000));
+    }
+    if (csv) fprintf(stderr, "%s: %lld copies retried\n", argv[0], retries);
+
+    free(s.waiters);
+    shmdt(shm);
+    return 0;
+}
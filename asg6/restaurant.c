@@ -0,0 +1,883 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sync.h"
+#include "restaurant.h"
+
+struct restaurant_config config = {
+    .cooks = 2,
+    .waiters = 5,
+    .tables = 10,
+    .waiter_queue_capacity = 97,
+    .cook_queue_capacity = 256,
+    .time_scale = 100000,
+    .virtual_time = 0,
+    .absolute_time = 0,
+    .cook_policy = POLICY_FIFO,
+    .batch_orders = 1,
+    .batch_persons = 0,
+    .batch_setup = 0,
+    .batch_per_person = 5,
+    .assign = ASSIGN_RR,
+    .steal = 0,
+    .max_cooks = 0,             // 0: same as cooks
+    .max_waiters = 0,
+};
+
+static const char *policy_names[] = {"fifo", "sjf", "aging", "fair", NULL};
+static const char *assign_names[] = {"rr", "shortest", "two", NULL};
+
+static const char *usage =
+    "Usage: %s [-v] [-a] [-f config file] [-c cooks] [-w waiters] [-t tables]\n"
+    "          [-q waiter queue] [-Q cook queue] [-s usec per minute]\n"
+    "          [-P fifo|sjf|aging|fair] [-b batch orders] [-B batch persons]\n"
+    "          [-k setup minutes per batch] [-K minutes per person]\n"
+    "          [-A rr|shortest|two] [-S] [-C max cooks] [-W max waiters]\n";
+
+const char *policy_name(int policy) {
+    return policy_names[policy];
+}
+
+const char *assign_name(int assign) {
+    return assign_names[assign];
+}
+
+// Index of a name in a NULL-terminated list, or -1
+static int name_index(const char **names, const char *name) {
+    for (int i = 0; names[i] != NULL; i++) {
+        if (strcmp(name, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Set one configuration key, as named in a config file
+static int config_set(const char *key, const char *text) {
+    if (strcmp(key, "policy") == 0) {
+        config.cook_policy = name_index(policy_names, text);
+        return config.cook_policy == -1 ? -1 : 0;
+    }
+    if (strcmp(key, "assign") == 0) {
+        config.assign = name_index(assign_names, text);
+        return config.assign == -1 ? -1 : 0;
+    }
+    char *end;
+    int value = strtol(text, &end, 10);
+    if (*end != '\0') return -1;
+    if (strcmp(key, "cooks") == 0) config.cooks = value;
+    else if (strcmp(key, "waiters") == 0) config.waiters = value;
+    else if (strcmp(key, "tables") == 0) config.tables = value;
+    else if (strcmp(key, "waiter_queue") == 0) config.waiter_queue_capacity = value;
+    else if (strcmp(key, "cook_queue") == 0) config.cook_queue_capacity = value;
+    else if (strcmp(key, "time_scale") == 0) config.time_scale = value;
+    else if (strcmp(key, "virtual") == 0) config.virtual_time = value;
+    else if (strcmp(key, "absolute") == 0) config.absolute_time = value;
+    else if (strcmp(key, "batch_orders") == 0) config.batch_orders = value;
+    else if (strcmp(key, "batch_persons") == 0) config.batch_persons = value;
+    else if (strcmp(key, "batch_setup") == 0) config.batch_setup = value;
+    else if (strcmp(key, "batch_per_person") == 0) config.batch_per_person = value;
+    else if (strcmp(key, "steal") == 0) config.steal = value;
+    else if (strcmp(key, "max_cooks") == 0) config.max_cooks = value;
+    else if (strcmp(key, "max_waiters") == 0) config.max_waiters = value;
+    else return -1;
+    return 0;
+}
+
+// Config file: one "key = value" per line, '#' starts a comment
+static void config_read_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash != NULL) *hash = '\0';
+        char key[64];
+        char value[64];
+        if (sscanf(line, " %63[a-z_] = %63s", key, value) == 2 ||
+            sscanf(line, " %63[a-z_] %63s", key, value) == 2) {
+            if (config_set(key, value) == -1) {
+                fprintf(stderr, "%s:%d: bad key or value '%s'\n", path, line_no, key);
+                exit(1);
+            }
+        } else {
+            char rest[2];
+            if (sscanf(line, " %1s", rest) == 1) {
+                fprintf(stderr, "%s:%d: expected 'key = value'\n", path, line_no);
+                exit(1);
+            }
+        }
+    }
+    fclose(fp);
+}
+
+void config_parse(int argc, char *argv[]) {
+    int opt;
+    while ((opt = getopt(argc, argv, CONFIG_OPTIONS)) != -1) {
+        switch (opt) {
+        case 'v': config.virtual_time = 1; break;
+        case 'a': config.absolute_time = 1; break;
+        case 'f': config_read_file(optarg); break;
+        case 'c': config.cooks = atoi(optarg); break;
+        case 'w': config.waiters = atoi(optarg); break;
+        case 't': config.tables = atoi(optarg); break;
+        case 'q': config.waiter_queue_capacity = atoi(optarg); break;
+        case 'Q': config.cook_queue_capacity = atoi(optarg); break;
+        case 's': config.time_scale = atoi(optarg); break;
+        case 'b': config.batch_orders = atoi(optarg); break;
+        case 'B': config.batch_persons = atoi(optarg); break;
+        case 'k': config.batch_setup = atoi(optarg); break;
+        case 'K': config.batch_per_person = atoi(optarg); break;
+        case 'P':
+            config.cook_policy = name_index(policy_names, optarg);
+            if (config.cook_policy == -1) {
+                fprintf(stderr, "%s: unknown policy '%s'\n", argv[0], optarg);
+                exit(1);
+            }
+            break;
+        case 'A':
+            config.assign = name_index(assign_names, optarg);
+            if (config.assign == -1) {
+                fprintf(stderr, "%s: unknown assignment '%s'\n", argv[0], optarg);
+                exit(1);
+            }
+            break;
+        case 'S': config.steal = 1; break;
+        case 'C': config.max_cooks = atoi(optarg); break;
+        case 'W': config.max_waiters = atoi(optarg); break;
+        default:
+            fprintf(stderr, usage, argv[0]);
+            exit(1);
+        }
+    }
+    if (config.cooks < 1 || config.waiters < 1 || config.tables < 1 ||
+        config.waiter_queue_capacity < 1 ||
+        config.cook_queue_capacity < 1 || config.time_scale < 0) {
+        fprintf(stderr, "%s: cooks, waiters, tables and queue sizes must be positive\n", argv[0]);
+        exit(1);
+    }
+    if (config.batch_orders < 1 || config.batch_persons < 0 ||
+        config.batch_setup < 0 || config.batch_per_person < 0 ||
+        config.batch_setup + config.batch_per_person == 0) {
+        fprintf(stderr, "%s: bad batch size or cooking times\n", argv[0]);
+        exit(1);
+    }
+    if (config.max_cooks == 0) config.max_cooks = config.cooks;
+    if (config.max_waiters == 0) config.max_waiters = config.waiters;
+    if (config.max_cooks < config.cooks || config.max_waiters < config.waiters) {
+        fprintf(stderr, "%s: the most cooks and waiters cannot be fewer than at opening\n", argv[0]);
+        exit(1);
+    }
+}
+
+#define ALIGN_LINE(n) (((n) + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1))
+
+// Work out the offsets of the variable-sized regions for the current
+// configuration. Returns the total size.
+static size_t shm_layout(struct restaurant_shm *layout) {
+    size_t offset = ALIGN_LINE(sizeof(struct restaurant_shm));
+    layout->waiter_area_size = ALIGN_LINE(sizeof(struct waiter_area) +
+                                          config.waiter_queue_capacity * sizeof(struct waiting_customer) +
+                                          config.tables * sizeof(int));
+    layout->waiter_areas = offset;
+    offset += config.max_waiters * layout->waiter_area_size;
+    layout->cook_slots = offset;
+    offset = ALIGN_LINE(offset + config.cook_queue_capacity * sizeof(struct cook_order));
+    layout->waiter_finish = offset;
+    offset = ALIGN_LINE(offset + config.max_waiters * sizeof(double));
+    layout->slot_free = offset;
+    offset = ALIGN_LINE(offset + config.tables * sizeof(int));
+    layout->slot_owner = offset;
+    offset = ALIGN_LINE(offset + config.tables * sizeof(int));
+    layout->slot_waiter = offset;
+    offset = ALIGN_LINE(offset + config.tables * sizeof(int));
+    layout->slot_cooked = offset;
+    offset = ALIGN_LINE(offset + config.tables * sizeof(int));
+    layout->cook_stats = offset;
+    offset += config.max_cooks * sizeof(struct cook_stats);
+    layout->waiter_stats = offset;
+    offset += config.max_waiters * sizeof(struct waiter_stats);
+    layout->occupancy = offset;
+    offset = ALIGN_LINE(offset + (config.tables + 1) * sizeof(long long));
+    layout->dispatch_slots = offset;
+    offset = ALIGN_LINE(offset + DISPATCH_CAPACITY * sizeof(struct customer_record));
+    layout->log_area = offset;
+    offset = ALIGN_LINE(offset + LOG_AREA_SIZE);
+    layout->sync_area = offset;
+    offset += sync_area_size(NUM_SEMS);
+    return offset;
+}
+
+size_t shm_size(void) {
+    struct restaurant_shm layout;
+    return shm_layout(&layout);
+}
+
+void shm_init(struct restaurant_shm *shm) {
+    memset(shm, 0, sizeof(*shm));
+    shm->magic = SHM_MAGIC;
+    shm->version = SHM_VERSION;
+    shm->header_size = sizeof(struct restaurant_shm);
+    shm->total_size = shm_layout(shm);
+    shm->config = config;
+
+    shm->time = 0;                      // Time is 11:00am
+    shm->tables.empty = config.tables;  // all tables empty
+    shm->tables.next_waiter = 0;        // First waiter is U (index 0)
+    shm->tables.active_waiters = config.waiters;
+    shm->cook_queue.cap = config.cook_queue_capacity;
+    for (int i = 0; i < config.max_waiters; i++) {
+        struct waiter_area *area = WAITER_AREA(shm, i);
+        area->seq = 0;
+        area->food_head = 0;
+        area->food_tail = 0;
+        area->po = 0;
+        area->head = 0;
+        area->tail = 0;
+        area->cap = config.waiter_queue_capacity;
+        area->busy = 0;
+        area->incoming = 0;
+        area->retire = 0;
+        area->steal_hint = 0;
+        WAITER_FINISH(shm)[i] = 0;
+    }
+    // Wake-up slots, slot 0 on top of the free stack
+    shm->tables.free_slots = config.tables;
+    for (int i = 0; i < config.tables; i++) {
+        SLOT_FREE(shm)[i] = config.tables - 1 - i;
+        SLOT_OWNER(shm)[i] = 0;
+        SLOT_WAITER(shm)[i] = 0;
+        SLOT_COOKED(shm)[i] = 0;
+    }
+    // A segment left over from an earlier run is reused, so clear the counters
+    memset(COOK_STATS(shm, 0), 0, config.max_cooks * sizeof(struct cook_stats));
+    memset(WAITER_STATS(shm, 0), 0, config.max_waiters * sizeof(struct waiter_stats));
+    memset(OCCUPANCY(shm), 0, (config.tables + 1) * sizeof(long long));
+    log_init(LOG_AREA(shm));
+}
+
+int shm_validate(struct restaurant_shm *shm, size_t size) {
+    if (size < sizeof(struct restaurant_shm) || shm->magic != SHM_MAGIC ||
+        shm->version != SHM_VERSION || shm->header_size != sizeof(struct restaurant_shm)) {
+        return -1;
+    }
+    config = shm->config;
+    // The offsets must be the ones this build would have used
+    struct restaurant_shm layout;
+    size_t total = shm_layout(&layout);
+    if (total != shm->total_size || total > size ||
+        layout.waiter_areas != shm->waiter_areas ||
+        layout.waiter_area_size != shm->waiter_area_size ||
+        layout.cook_slots != shm->cook_slots ||
+        layout.waiter_finish != shm->waiter_finish ||
+        layout.slot_free != shm->slot_free ||
+        layout.slot_owner != shm->slot_owner ||
+        layout.slot_waiter != shm->slot_waiter ||
+        layout.slot_cooked != shm->slot_cooked ||
+        layout.cook_stats != shm->cook_stats ||
+        layout.waiter_stats != shm->waiter_stats ||
+        layout.occupancy != shm->occupancy ||
+        layout.dispatch_slots != shm->dispatch_slots ||
+        layout.log_area != shm->log_area ||
+        layout.sync_area != shm->sync_area) {
+        return -1;
+    }
+    return 0;
+}
+
+// Names are built once per id and kept, so callers may hold on to them
+struct name_table {
+    char **names;
+    int count;
+};
+
+static const char *table_name(struct name_table *t, int id, char letter, int first_numbered) {
+    if (id >= t->count) {
+        int count = id + 1 > 2 * t->count ? id + 1 : 2 * t->count;
+        char **names = realloc(t->names, count * sizeof(char *));
+        if (names == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+        for (int i = t->count; i < count; i++) {
+            names[i] = malloc(16);
+            if (names[i] == NULL) {
+                perror("malloc");
+                exit(1);
+            }
+            if (i < first_numbered) sprintf(names[i], "%c", letter + i);
+            else sprintf(names[i], "%c%d", letter, i);
+        }
+        t->names = names;
+        t->count = count;
+    }
+    return t->names[id];
+}
+
+const char *cook_name(int cook_id) {
+    static struct name_table cooks;
+    return table_name(&cooks, cook_id, 'C', 'U' - 'C');
+}
+
+const char *waiter_name(int waiter_id) {
+    static struct name_table waiters;
+    return table_name(&waiters, waiter_id, 'U', 'Z' - 'U' + 1);
+}
+
+// Cook C prints at the margin and the others one tab in, waiter U at the
+// margin and every later waiter two more spaces in, up to a limit
+const char *cook_indent(int cook_id) {
+    return cook_id == 0 ? "" : "\t";
+}
+
+const char *waiter_indent(int waiter_id) {
+    static const char spaces[] = "                ";
+    int n = 2 * waiter_id;
+    if (n > (int)sizeof(spaces) - 1) n = sizeof(spaces) - 1;
+    return spaces + sizeof(spaces) - 1 - n;
+}
+
+void sem_name(int sem_num, char *buf, size_t len) {
+    int waiters = config.max_waiters;
+    if (sem_num == MUTEX) snprintf(buf, len, "MUTEX");
+    else if (sem_num == COOK_SEM) snprintf(buf, len, "COOK_SEM");
+    else if (sem_num == TABLE_LOCK) snprintf(buf, len, "TABLE_LOCK");
+    else if (sem_num == COOK_QUEUE_LOCK) snprintf(buf, len, "COOK_QUEUE_LOCK");
+    else if (sem_num == DISPATCH_LOCK) snprintf(buf, len, "DISPATCH_LOCK");
+    else if (sem_num == DISPATCH_ITEMS) snprintf(buf, len, "DISPATCH_ITEMS");
+    else if (sem_num == DISPATCH_SPACE) snprintf(buf, len, "DISPATCH_SPACE");
+    else if (sem_num == CUSTOMER_DONE) snprintf(buf, len, "CUSTOMER_DONE");
+    else if (sem_num == OPENED(0)) snprintf(buf, len, "OPENED(cooks)");
+    else if (sem_num == OPENED(1)) snprintf(buf, len, "OPENED(waiters)");
+    else if (sem_num < FIXED_SEMS + waiters) {
+        snprintf(buf, len, "WAITER_SEM(%s)", waiter_name(sem_num - FIXED_SEMS));
+    } else if (sem_num < FIXED_SEMS + 2 * waiters) {
+        snprintf(buf, len, "WAITER_QUEUE_LOCK(%s)", waiter_name(sem_num - FIXED_SEMS - waiters));
+    } else {
+        snprintf(buf, len, "CUSTOMER_SEM(%d)", sem_num - FIXED_SEMS - 2 * waiters);
+    }
+}
+
+// Function to display current time
+void print_time(int minutes) {
+    fprint_time(stdout, minutes);
+}
+
+void fprint_time(FILE *fp, int minutes) {
+    int hour = 11 + minutes / 60;
+    int minute = minutes % 60;
+    char am_pm = (hour < 12) ? 'a' : 'p';
+    if (hour > 12) hour -= 12;
+    fprintf(fp, "[%d:%02d %cm] ", hour, minute, am_pm);
+}
+
+void seq_write_begin(unsigned int *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    // The group's stores must not be seen before the odd count
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void seq_write_end(unsigned int *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+unsigned int seq_read_begin(const unsigned int *seq) {
+    unsigned int start;
+    while ((start = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1) {
+        // A writer is in its section; it holds the lock only briefly
+    }
+    return start;
+}
+
+int seq_read_retry(const unsigned int *seq, unsigned int start) {
+    // The copy must be complete before the count is checked again
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+int clock_now(struct restaurant_shm *shm) {
+    return __atomic_load_n(&shm->time, __ATOMIC_ACQUIRE);
+}
+
+int clock_advance(struct restaurant_shm *shm, int time) {
+    int now = __atomic_load_n(&shm->time, __ATOMIC_ACQUIRE);
+    while (time > now) {
+        if (__atomic_compare_exchange_n(&shm->time, &now, time, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return time;
+        }
+    }
+    return now;
+}
+
+int cooking_time(int persons) {
+    return config.batch_setup + config.batch_per_person * persons;
+}
+
+// Heap order: smaller key first, then earlier arrival
+static int order_before(const struct cook_order *a, const struct cook_order *b) {
+    return a->key < b->key || (a->key == b->key && a->seq - b->seq < 0);
+}
+
+static void heap_push(struct cook_order *heap, int n, const struct cook_order *order) {
+    int i = n;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!order_before(order, &heap[parent])) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = *order;
+}
+
+static void heap_pop(struct cook_order *heap, int n, struct cook_order *top) {
+    *top = heap[0];
+    struct cook_order last = heap[--n];
+    int i = 0;
+    while (2 * i + 1 < n) {
+        int child = 2 * i + 1;
+        if (child + 1 < n && order_before(&heap[child + 1], &heap[child])) child++;
+        if (!order_before(&heap[child], &last)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+}
+
+// Keys, in minutes:
+//   sjf    cooking time
+//   aging  cooking time - AGING_CREDIT * minutes waited. The time now is the
+//          same for every order in the queue, so cooking time +
+//          AGING_CREDIT * enqueue time sorts the same way and never changes.
+//   fair   virtual finish time: the waiter's previous finish time, or the
+//          virtual start of the last order taken if that is later, plus
+//          cooking time (start-time fair queuing). Each waiter with orders queued gets an equal share
+//          of the cooks, however many orders the others have queued.
+int cook_queue_push(struct restaurant_shm *shm, const struct cook_order *order) {
+    int tail = shm->cook_queue.tail;
+    int cap = shm->cook_queue.cap;
+    if (tail - shm->cook_queue.head >= cap) return -1;
+    int policy = shm->config.cook_policy;
+    if (policy == POLICY_FIFO) {
+        COOK_SLOTS(shm)[tail % cap] = *order;
+    } else {
+        struct cook_order entry = *order;
+        int cook_time = cooking_time(order->count);
+        entry.seq = tail;
+        if (policy == POLICY_SJF) {
+            entry.key = cook_time;
+        } else if (policy == POLICY_AGING) {
+            entry.key = cook_time + AGING_CREDIT * order->enqueue_time;
+        } else {
+            double *finish = &WAITER_FINISH(shm)[order->waiter_id];
+            double start = *finish > shm->cook_queue.vtime ? *finish : shm->cook_queue.vtime;
+            *finish = start + cook_time;
+            entry.key = *finish;
+        }
+        heap_push(COOK_SLOTS(shm), tail - shm->cook_queue.head, &entry);
+    }
+    shm->cook_queue.tail = tail + 1;
+    shm->cook_queue.pending++;
+    return 0;
+}
+
+int cook_queue_pop(struct restaurant_shm *shm, struct cook_order *order) {
+    int head = shm->cook_queue.head;
+    int n = shm->cook_queue.tail - head;
+    if (n == 0) return -1;
+    if (shm->config.cook_policy == POLICY_FIFO) {
+        *order = COOK_SLOTS(shm)[head % shm->cook_queue.cap];
+    } else {
+        heap_pop(COOK_SLOTS(shm), n, order);
+        if (shm->config.cook_policy == POLICY_FAIR) {
+            shm->cook_queue.vtime = order->key - cooking_time(order->count);
+        }
+    }
+    shm->cook_queue.head = head + 1;
+    shm->cook_queue.pending--;
+    return 0;
+}
+
+int cook_queue_peek(struct restaurant_shm *shm, struct cook_order *order) {
+    int head = shm->cook_queue.head;
+    if (head == shm->cook_queue.tail) return -1;
+    if (shm->config.cook_policy == POLICY_FIFO) {
+        *order = COOK_SLOTS(shm)[head % shm->cook_queue.cap];
+    } else {
+        *order = COOK_SLOTS(shm)[0];
+    }
+    return 0;
+}
+
+int waiter_queue_push(struct waiter_area *area, const struct waiting_customer *customer) {
+    int tail = area->tail;
+    int cap = area->cap;
+    if (tail - area->head >= cap) return -1;
+    area->queue[tail % cap] = *customer;
+    area->tail = tail + 1;
+    area->po++;       // stores the number of pending orders.
+    return 0;
+}
+
+void food_push(struct waiter_area *area, int slot) {
+    WAITER_FOOD(area)[area->food_tail % config.tables] = slot;
+    area->food_tail++;
+}
+
+int food_pop(struct waiter_area *area, int *slot) {
+    if (area->food_head == area->food_tail) return -1;
+    *slot = WAITER_FOOD(area)[area->food_head % config.tables];
+    area->food_head++;
+    return 0;
+}
+
+int food_ready(struct waiter_area *area) {
+    return area->food_tail - area->food_head;
+}
+
+int waiter_queue_pop(struct waiter_area *area, struct waiting_customer *customer) {
+    int head = area->head;
+    if (head == area->tail) return -1;
+    *customer = area->queue[head % area->cap];
+    area->head = head + 1;
+    area->po--;
+    return 0;
+}
+
+int waiter_queue_peek(struct waiter_area *area, struct waiting_customer *customer) {
+    if (area->head == area->tail) return -1;
+    *customer = area->queue[area->head % area->cap];
+    return 0;
+}
+
+void dispatch_push(struct restaurant_shm *shm, const struct customer_record *record) {
+    int tail = shm->dispatch.tail;
+    DISPATCH_SLOTS(shm)[tail % DISPATCH_CAPACITY] = *record;
+    shm->dispatch.tail = tail + 1;
+}
+
+void dispatch_pop(struct restaurant_shm *shm, struct customer_record *record) {
+    int head = shm->dispatch.head;
+    *record = DISPATCH_SLOTS(shm)[head % DISPATCH_CAPACITY];
+    shm->dispatch.head = head + 1;
+}
+
+static void stats_max(int *max, int value) {
+    int old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // old now holds the current maximum, try again
+    }
+}
+
+void hist_add(struct histogram *h, int value) {
+    int bucket = 0;
+    for (int v = value; v > 0 && bucket < HIST_BUCKETS - 1; v >>= 1) bucket++;
+    __atomic_add_fetch(&h->buckets[bucket], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->sum, value, __ATOMIC_RELAXED);
+    stats_max(&h->max, value);
+}
+
+int hist_percentile(const struct histogram *h, double fraction) {
+    long long total = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) total += h->buckets[b];
+    long long seen = 0;
+    for (int b = 0; b < HIST_BUCKETS - 1; b++) {
+        seen += h->buckets[b];
+        int bound = (1 << b) - 1;
+        if (seen >= fraction * total) return bound < h->max ? bound : h->max;
+    }
+    return h->max;
+}
+
+void stats_order_taken(struct restaurant_shm *shm, int wait) {
+    hist_add(&shm->stats.order_wait, wait);
+}
+
+void stats_batch_done(struct restaurant_shm *shm, int cook_id, int orders, int minutes, int done_time) {
+    __atomic_add_fetch(&shm->stats.batches, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shm->stats.cook_minutes, minutes, __ATOMIC_RELAXED);
+    stats_max(&shm->stats.last_done, done_time);
+    struct cook_stats *cook = COOK_STATS(shm, cook_id);
+    __atomic_add_fetch(&cook->orders, orders, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&cook->passes, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&cook->minutes, minutes, __ATOMIC_RELAXED);
+}
+
+void stats_order_placed(struct restaurant_shm *shm, int wait) {
+    hist_add(&shm->stats.placement, wait);
+}
+
+void stats_waiter_placed(struct restaurant_shm *shm, int waiter_id) {
+    __atomic_add_fetch(&WAITER_STATS(shm, waiter_id)->placed, 1, __ATOMIC_RELAXED);
+}
+
+void stats_waiter_served(struct restaurant_shm *shm, int waiter_id) {
+    __atomic_add_fetch(&WAITER_STATS(shm, waiter_id)->served, 1, __ATOMIC_RELAXED);
+}
+
+void stats_customer_stolen(struct restaurant_shm *shm, int waiter_id) {
+    __atomic_add_fetch(&shm->stats.steals, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&WAITER_STATS(shm, waiter_id)->stolen, 1, __ATOMIC_RELAXED);
+}
+
+void stats_rejected(struct restaurant_shm *shm, int reason) {
+    __atomic_add_fetch(&shm->stats.rejected[reason], 1, __ATOMIC_RELAXED);
+}
+
+void stats_tables(struct restaurant_shm *shm) {
+    int now = clock_now(shm);
+    int occupied = config.tables - shm->tables.empty;
+    int t = shm->tables.occupancy_since;
+    if (now <= t) return;
+    __atomic_add_fetch(&OCCUPANCY(shm)[occupied], now - t, __ATOMIC_RELAXED);
+    // Split the interval at the hours
+    while (t < now) {
+        int hour = t / 60 < OCCUPANCY_HOURS - 1 ? t / 60 : OCCUPANCY_HOURS - 1;
+        int end = (hour < OCCUPANCY_HOURS - 1 && (hour + 1) * 60 < now) ? (hour + 1) * 60 : now;
+        __atomic_add_fetch(&shm->tables.occupied_minutes[hour], (long long)occupied * (end - t),
+                           __ATOMIC_RELAXED);
+        t = end;
+    }
+    shm->tables.occupancy_since = now;
+}
+
+void stats_cook_wakeup(struct restaurant_shm *shm, int spurious) {
+    __atomic_add_fetch(&shm->stats.cook_wakeups, 1, __ATOMIC_RELAXED);
+    if (spurious) __atomic_add_fetch(&shm->stats.cook_spurious, 1, __ATOMIC_RELAXED);
+}
+
+void stats_waiter_wakeup(struct restaurant_shm *shm, int spurious) {
+    __atomic_add_fetch(&shm->stats.waiter_wakeups, 1, __ATOMIC_RELAXED);
+    if (spurious) __atomic_add_fetch(&shm->stats.waiter_spurious, 1, __ATOMIC_RELAXED);
+}
+
+void stats_pool(struct restaurant_shm *shm, int cook_hires, int waiter_hires,
+                int cook_minutes, int waiter_minutes) {
+    __atomic_add_fetch(&shm->stats.cook_hires, cook_hires, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shm->stats.waiter_hires, waiter_hires, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shm->stats.cook_minutes_paid, cook_minutes, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&shm->stats.waiter_minutes_paid, waiter_minutes, __ATOMIC_RELAXED);
+}
+
+void stats_customer_served(struct restaurant_shm *shm, int wait, int cooking) {
+    hist_add(&shm->stats.customer_wait, wait);
+    hist_add(&shm->stats.cooking, cooking);
+}
+
+static void report_histogram(FILE *fp, const char *name, const struct histogram *h) {
+    fprintf(fp, "  %-16s %6lld %7.2f %5d %5d %5d\n", name, h->count,
+            h->count ? (double)h->sum / h->count : 0.0,
+            hist_percentile(h, 0.5), hist_percentile(h, 0.99), h->max);
+}
+
+// Tables in use that at least `fraction` of the time open was spent at or under
+static int occupancy_percentile(struct restaurant_shm *shm, long long total, double fraction) {
+    long long seen = 0;
+    for (int n = 0; n < shm->config.tables; n++) {
+        seen += OCCUPANCY(shm)[n];
+        if (seen >= fraction * total) return n;
+    }
+    return shm->config.tables;
+}
+
+void stats_report(struct restaurant_shm *shm, int semid, FILE *fp) {
+    long long orders = shm->stats.order_wait.count;
+    long long served = shm->stats.customer_wait.count;
+    fprintf(fp, "policy %s: %lld orders, queue wait mean %.2f max %d; "
+            "%lld customers served, wait mean %.2f max %d\n",
+            policy_name(shm->config.cook_policy),
+            orders, orders ? (double)shm->stats.order_wait.sum / orders : 0.0, shm->stats.order_wait.max,
+            served, served ? (double)shm->stats.customer_wait.sum / served : 0.0,
+            shm->stats.customer_wait.max);
+    // Throughput over the time from opening to the last order prepared
+    long long batches = shm->stats.batches;
+    int span = shm->stats.last_done;
+    fprintf(fp, "batch %d orders/%d persons, %d + %d min/person: %lld passes, "
+            "%.2f orders each, %lld cook minutes, %.2f orders per hour\n",
+            shm->config.batch_orders, shm->config.batch_persons,
+            shm->config.batch_setup, shm->config.batch_per_person,
+            batches, batches ? (double)orders / batches : 0.0, shm->stats.cook_minutes,
+            span ? orders * 60.0 / span : 0.0);
+    long long placed = shm->stats.placement.count;
+    fprintf(fp, "assign %s%s: %lld orders placed, placement wait mean %.2f max %d, %lld steals\n",
+            assign_name(shm->config.assign), shm->config.steal ? " + steal" : "",
+            placed, placed ? (double)shm->stats.placement.sum / placed : 0.0,
+            shm->stats.placement.max, shm->stats.steals);
+    fprintf(fp, "wake-ups: cooks %lld (%lld spurious), waiters %lld (%lld spurious)\n",
+            shm->stats.cook_wakeups, shm->stats.cook_spurious,
+            shm->stats.waiter_wakeups, shm->stats.waiter_spurious);
+    // Staff minutes are only counted by the supervisors
+    if (shm->config.max_cooks > shm->config.cooks || shm->config.max_waiters > shm->config.waiters) {
+        fprintf(fp, "pool cooks %d..%d, waiters %d..%d: %lld cooks and %lld waiters called in, "
+                "%lld cook minutes and %lld waiter minutes on duty\n",
+                shm->config.cooks, shm->config.max_cooks, shm->config.waiters, shm->config.max_waiters,
+                shm->stats.cook_hires, shm->stats.waiter_hires,
+                shm->stats.cook_minutes_paid, shm->stats.waiter_minutes_paid);
+    }
+    // Real time only: how far the wake-ups strayed from the schedule
+    struct sync_timing timing;
+    if (!shm->config.virtual_time && sync_timing(semid, &timing) == 0 && timing.sleeps > 0) {
+        fprintf(fp, "timing %s: %lld sleeps, late mean %.0f us, jitter %.0f us, "
+                "max %lld us late, %lld us early\n",
+                timing.absolute ? "absolute" : "relative", timing.sleeps,
+                timing.late_mean, timing.late_stddev, timing.late_max, timing.early_max);
+    }
+
+    fprintf(fp, "latency in minutes    count    mean   p50   p99   max\n");
+    report_histogram(fp, "arrival-placed", &shm->stats.placement);
+    report_histogram(fp, "placed-cooking", &shm->stats.order_wait);
+    report_histogram(fp, "cooking-served", &shm->stats.cooking);
+    report_histogram(fp, "arrival-served", &shm->stats.customer_wait);
+    fprintf(fp, "rejected: %lld late, %lld no table, %lld waiter overloaded\n",
+            shm->stats.rejected[REJECT_LATE], shm->stats.rejected[REJECT_NO_TABLE],
+            shm->stats.rejected[REJECT_OVERLOADED]);
+
+    // Occupancy up to the last time a table was taken or freed
+    long long open_minutes = 0;
+    long long table_minutes = 0;
+    for (int n = 0; n <= shm->config.tables; n++) {
+        open_minutes += OCCUPANCY(shm)[n];
+        table_minutes += n * OCCUPANCY(shm)[n];
+    }
+    if (open_minutes > 0) {
+        fprintf(fp, "occupancy of %d tables: mean %.2f, p50 %d, p99 %d, max %d; by hour",
+                shm->config.tables, (double)table_minutes / open_minutes,
+                occupancy_percentile(shm, open_minutes, 0.5),
+                occupancy_percentile(shm, open_minutes, 0.99),
+                occupancy_percentile(shm, open_minutes, 1.0));
+        int since = shm->tables.occupancy_since;
+        for (int h = 0; h < OCCUPANCY_HOURS && h * 60 < since; h++) {
+            int minutes = since - h * 60;
+            if (h < OCCUPANCY_HOURS - 1 && minutes > 60) minutes = 60;
+            int hour = 11 + h > 12 ? h - 1 : 11 + h;
+            fprintf(fp, " %d%s %.2f", hour, 11 + h < 12 ? "am" : "pm",
+                    (double)shm->tables.occupied_minutes[h] / minutes);
+        }
+        fprintf(fp, "\n");
+    }
+
+    for (int i = 0; i < shm->config.max_cooks; i++) {
+        struct cook_stats *cook = COOK_STATS(shm, i);
+        if (cook->passes == 0) continue;
+        fprintf(fp, "cook %s: %lld orders in %lld passes, %lld minutes cooking\n",
+                cook_name(i), cook->orders, cook->passes, cook->minutes);
+    }
+    for (int i = 0; i < shm->config.max_waiters; i++) {
+        struct waiter_stats *waiter = WAITER_STATS(shm, i);
+        if (waiter->placed == 0 && waiter->served == 0) continue;
+        fprintf(fp, "waiter %s: %lld orders placed, %lld served, %lld customers stolen\n",
+                waiter_name(i), waiter->placed, waiter->served, waiter->stolen);
+    }
+}
+
+static void json_histogram(FILE *fp, const char *name, const struct histogram *h) {
+    fprintf(fp, ",\"%s_count\":%lld,\"%s_mean\":%.3f,\"%s_p50\":%d,\"%s_p99\":%d,\"%s_max\":%d",
+            name, h->count, name, h->count ? (double)h->sum / h->count : 0.0,
+            name, hist_percentile(h, 0.5), name, hist_percentile(h, 0.99), name, h->max);
+}
+
+void stats_json(struct restaurant_shm *shm, int semid, double wall_seconds, FILE *fp) {
+    long long served = shm->stats.customer_wait.count;
+    fprintf(fp, "{\"wall_s\":%.6f,\"served\":%lld,\"served_per_s\":%.1f,\"syscalls\":%lld",
+            wall_seconds, served, wall_seconds > 0 ? served / wall_seconds : 0.0,
+            sync_syscalls_total(semid));
+    fprintf(fp, ",\"rejected_late\":%lld,\"rejected_no_table\":%lld,\"rejected_overloaded\":%lld",
+            shm->stats.rejected[REJECT_LATE], shm->stats.rejected[REJECT_NO_TABLE],
+            shm->stats.rejected[REJECT_OVERLOADED]);
+    fprintf(fp, ",\"steals\":%lld,\"cook_wakeups\":%lld,\"waiter_wakeups\":%lld",
+            shm->stats.steals, shm->stats.cook_wakeups, shm->stats.waiter_wakeups);
+    json_histogram(fp, "placement", &shm->stats.placement);
+    json_histogram(fp, "order_wait", &shm->stats.order_wait);
+    json_histogram(fp, "cooking", &shm->stats.cooking);
+    json_histogram(fp, "customer_wait", &shm->stats.customer_wait);
+    fprintf(fp, "}\n");
+}
+
+int slot_lease(struct restaurant_shm *shm, int customer_id) {
+    if (shm->tables.free_slots == 0) return -1;
+    int slot = SLOT_FREE(shm)[--shm->tables.free_slots];
+    SLOT_OWNER(shm)[slot] = customer_id;
+    return slot;
+}
+
+void slot_release(struct restaurant_shm *shm, int slot) {
+    SLOT_OWNER(shm)[slot] = 0;
+    SLOT_FREE(shm)[shm->tables.free_slots++] = slot;
+}
+
+// Customers queued for a waiter, plus one if it is working on something
+static int waiter_load(struct restaurant_shm *shm, int waiter_id) {
+    struct waiter_area *area = WAITER_AREA(shm, waiter_id);
+    return __atomic_load_n(&area->po, __ATOMIC_RELAXED) +
+           __atomic_load_n(&area->busy, __ATOMIC_RELAXED);
+}
+
+static int waiter_choose(struct restaurant_shm *shm, int customer_id) {
+    int waiters = shm->tables.active_waiters;
+    int first = shm->tables.next_waiter % waiters;
+    shm->tables.next_waiter = (first + 1) % waiters;  // Update next waiter in circular fashion
+    if (config.assign == ASSIGN_RR || waiters == 1) return first;
+
+    if (config.assign == ASSIGN_SHORTEST) {
+        // Scan from the round robin position, so ties are spread out
+        int best = first;
+        int best_load = waiter_load(shm, first);
+        for (int i = 1; i < waiters && best_load > 0; i++) {
+            int w = (first + i) % waiters;
+            int load = waiter_load(shm, w);
+            if (load < best_load) {
+                best = w;
+                best_load = load;
+            }
+        }
+        return best;
+    }
+
+    // Two distinct waiters, chosen by a hash of the customer id so that a
+    // run does not depend on which process seats whom
+    unsigned int h = (unsigned int)customer_id * 2654435761u;
+    int a = (h >> 16) % waiters;
+    int b = (a + 1 + (h & 0xffff) % (waiters - 1)) % waiters;
+    return waiter_load(shm, b) < waiter_load(shm, a) ? b : a;
+}
+
+int waiter_pick(struct restaurant_shm *shm, int customer_id) {
+    int waiter_id = waiter_choose(shm, customer_id);
+    __atomic_add_fetch(&WAITER_AREA(shm, waiter_id)->incoming, 1, __ATOMIC_RELAXED);
+    return waiter_id;
+}
+
+void waiter_arrived(struct restaurant_shm *shm, int waiter_id) {
+    __atomic_sub_fetch(&WAITER_AREA(shm, waiter_id)->incoming, 1, __ATOMIC_RELEASE);
+}
+
+int waiter_idle(struct waiter_area *area) {
+    return area->po == 0 && food_ready(area) == 0 && !area->busy && !area->retire &&
+           !area->steal_hint;
+}
+
+int waiter_hint(struct restaurant_shm *shm, int busy_waiter) {
+    if (!config.steal ||
+        __atomic_load_n(&WAITER_AREA(shm, busy_waiter)->po, __ATOMIC_RELAXED) < STEAL_MIN) {
+        return -1;
+    }
+    // The next idle one after the busy waiter, so that hints are spread out
+    int waiters = __atomic_load_n(&shm->tables.active_waiters, __ATOMIC_RELAXED);
+    for (int i = 1; i < waiters; i++) {
+        int w = (busy_waiter + i) % waiters;
+        struct waiter_area *area = WAITER_AREA(shm, w);
+        if (w != busy_waiter && __atomic_load_n(&area->po, __ATOMIC_RELAXED) == 0 &&
+            !__atomic_load_n(&area->busy, __ATOMIC_RELAXED) &&
+            !__atomic_load_n(&area->steal_hint, __ATOMIC_RELAXED)) {
+            return w;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,455 @@
+#ifndef RESTAURANT_H
+#define RESTAURANT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+#include "log.h"
+
+// Shared memory and semaphore layout used by cook, waiter and customer.
+//
+// The restaurant's size is read at run time (see config_parse()) by cook,
+// which creates the segment and lays it out (shm_init()). waiter and
+// customer attach to the existing segment, check that it was laid out by
+// a matching build and load the configuration from it (shm_validate()).
+// engine runs all three in one process on a private copy (see engine.c).
+
+struct restaurant_config {
+    int cooks;
+    int waiters;
+    int tables;
+    int waiter_queue_capacity;  // customers queued per waiter
+    int cook_queue_capacity;    // orders queued for the cooks
+    int time_scale;             // microseconds of real time per simulated minute
+    int virtual_time;           // 1: discrete-event run, see sync.h
+    int absolute_time;          // 1: real time sleeps to deadlines, see sync_set_epoch()
+    int cook_policy;            // POLICY_*, which order cooks take orders in
+    int batch_orders;           // most orders a cook takes in one pass
+    int batch_persons;          // most persons in one pass, 0: no limit
+    int batch_setup;            // minutes per pass, see cooking_time()
+    int batch_per_person;       // minutes per person
+    int assign;                 // ASSIGN_*, how arriving customers pick a waiter
+    int steal;                  // 1: idle waiters take customers queued for others
+    int max_cooks;              // cooks and waiters the supervisors may add, on top of
+    int max_waiters;            // cooks and waiters, when busy (see below)
+};
+
+// Cook scheduling policies
+#define POLICY_FIFO 0       // order of arrival
+#define POLICY_SJF 1        // shortest cooking time first
+#define POLICY_AGING 2      // shortest first, but every minute waited takes
+                            // AGING_CREDIT minutes off the cooking time
+#define POLICY_FAIR 3       // fair queuing between waiters on cooking time
+#define AGING_CREDIT 0.5
+
+// Waiter assignment, see waiter_pick()
+#define ASSIGN_RR 0         // round robin
+#define ASSIGN_SHORTEST 1   // least loaded waiter
+#define ASSIGN_TWO 2        // less loaded of two waiters picked at random
+
+// An idle waiter only steals from a waiter with at least this many
+// customers queued, so the victim still has work of its own
+#define STEAL_MIN 2
+
+// Elastic pools: with max_cooks > cooks (or max_waiters > waiters) the
+// cook (waiter) main process stays on as a supervisor. Every
+// SUPERVISE_PERIOD minutes it calls in one more cook when more than
+// SCALE_UP_BACKLOG orders per cook are pending or the next order has
+// waited SCALE_UP_WAIT minutes, and one more waiter when more than
+// SCALE_UP_BACKLOG customers or plates per waiter are waiting or a
+// customer has waited SCALE_UP_ORDER_WAIT minutes to order this period.
+// In virtual time the supervisor looks when everyone else is blocked, so
+// queues have mostly drained by then and the wait is what shows. After
+// IDLE_PERIODS quiet periods in a row it sends one home, down to the
+// opening number. Per-waiter regions and semaphores are sized for
+// max_waiters.
+#define SUPERVISE_PERIOD 5
+#define SCALE_UP_BACKLOG 2
+#define SCALE_UP_WAIT 15
+#define SCALE_UP_ORDER_WAIT 5       // taking an order is a minute
+#define IDLE_PERIODS 4
+// Supervisors running, counted in shm->ready like cooks and waiters
+#define SUPERVISORS ((config.max_cooks > config.cooks) + (config.max_waiters > config.waiters))
+
+extern struct restaurant_config config;
+
+#define TIME_SCALE (config.time_scale)  // default 100ms = 100000 microseconds per minute
+
+#define CACHE_LINE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE)))
+
+#define SHM_MAGIC 0x52545352        // "RSTR" on little-endian machines
+#define SHM_VERSION 12              // bump when struct restaurant_shm changes
+
+// One slot of the cook queue
+struct cook_order {
+    int waiter_id;
+    int customer_id;
+    int count;
+    int slot;               // customer's wake-up slot
+    int enqueue_time;       // when the waiter placed it
+    int seq;                // set by cook_queue_push(), breaks ties in order of arrival
+    double key;             // set by cook_queue_push(), priority for the heap policies
+};
+
+// One slot of a waiter's customer queue
+struct waiting_customer {
+    int customer_id;
+    int count;
+    int slot;
+    int queue_time;         // when the customer was queued
+};
+
+// One line of customers.txt, and one slot of the dispatch queue
+struct customer_record {
+    int customer_id;        // -1 tells a pool worker to stop
+    int arrival_time;
+    int count;
+};
+
+// Latency histogram, in minutes, with log2 buckets: bucket 0 counts 0,
+// bucket b counts 2^(b-1) .. 2^b - 1, and the last one everything above.
+// Updated with atomic adds, see hist_add().
+#define HIST_BUCKETS 16
+struct histogram {
+    long long buckets[HIST_BUCKETS];
+    long long count;
+    long long sum;
+    int max;
+};
+
+// Reasons a customer leaves without eating, see stats_rejected()
+#define REJECT_LATE 0           // arrived after 3:00pm
+#define REJECT_NO_TABLE 1
+#define REJECT_OVERLOADED 2     // the waiter's queue was full
+#define REJECT_REASONS 3
+
+// Table occupancy is kept per hour from 11:00am, the last hour taking the rest
+#define OCCUPANCY_HOURS 6
+
+// Per-actor counters, each written by its own cook or waiter only. on_duty
+// is set when the cook or waiter is started and cleared by it as it
+// leaves, before sync_actor_done(), so that a supervisor knows who has
+// gone at the same point of every virtual time run.
+struct cook_stats {
+    long long orders;       // orders prepared
+    long long passes;       // batches cooked
+    long long minutes;      // time spent cooking
+    int on_duty;
+} CACHE_ALIGNED;
+
+struct waiter_stats {
+    long long placed;       // orders taken and placed with the cooks
+    long long served;       // food served
+    long long stolen;       // customers taken from other waiters
+    int on_duty;
+} CACHE_ALIGNED;
+
+// Start of the segment. Each counter that is written often, and each group
+// of fields guarded by one lock, has a cache line to itself so that
+// processes working on different things do not keep stealing the line
+// from each other. The variable-sized regions follow, at the byte offsets
+// recorded here, each starting on a cache line.
+//
+// Each lock-guarded group (tables, cook_queue, each waiter_area) starts
+// with a seqcount, so that monitor can read a consistent copy without
+// taking the lock. A process that changes the group bumps it to odd with
+// seq_write_begin() after taking the lock and back to even with
+// seq_write_end() before releasing it; the lock already keeps writers
+// apart, so this never blocks anyone.
+struct restaurant_shm {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int header_size;   // sizeof(struct restaurant_shm) of the creator
+    unsigned int pad;
+    size_t total_size;          // bytes used, up to the end of the sync area
+    struct restaurant_config config;
+
+    size_t waiter_areas;        // config.max_waiters struct waiter_area
+    size_t waiter_area_size;    // stride between them
+    size_t cook_slots;          // struct cook_order[cook_queue_capacity]
+    size_t waiter_finish;       // double[max_waiters], virtual finish times for POLICY_FAIR
+    size_t slot_free;           // int[tables]
+    size_t slot_owner;          // int[tables]
+    size_t slot_waiter;         // int[tables]
+    size_t slot_cooked;         // int[tables]
+    size_t cook_stats;          // struct cook_stats[max_cooks]
+    size_t waiter_stats;        // struct waiter_stats[max_waiters]
+    size_t occupancy;           // long long[tables + 1], see stats_tables()
+    size_t dispatch_slots;      // struct customer_record[DISPATCH_CAPACITY]
+    size_t log_area;            // see log.h
+    size_t sync_area;           // see sync.h
+
+    int time CACHE_ALIGNED;     // simulated clock, see clock_now()
+    int ready CACHE_ALIGNED;    // cooks, waiters and supervisors that have started
+    int open;                   // set by customer once it has started too
+
+    struct {                    // guarded by TABLE_LOCK
+        unsigned int seq;
+        int empty;
+        int next_waiter;
+        int free_slots;         // entries on the slot_free stack
+        int active_waiters;     // waiters 0..active_waiters-1 take new customers
+        int occupancy_since;    // time of the last change to empty, see stats_tables()
+        long long occupied_minutes[OCCUPANCY_HOURS];    // tables in use x minutes
+    } tables CACHE_ALIGNED;
+
+    struct {                    // guarded by COOK_QUEUE_LOCK
+        unsigned int seq;
+        int head;               // free-running ring counters, slot = counter % cap
+        int tail;               // (the heap policies keep tail - head orders in
+        int cap;                // slots 0.. instead)
+        int pending;
+        int cooking;            // orders taken by cooks, not yet handed to a waiter
+        int retire;             // cooks the supervisor has sent home, not yet gone
+        double vtime;           // POLICY_FAIR: virtual start of the last order taken
+    } cook_queue CACHE_ALIGNED;
+
+    struct {                    // updated with atomic adds
+        struct histogram placement;     // arrival to order placed
+        struct histogram order_wait;    // order placed to a cook taking it
+        struct histogram cooking;       // cook taking the order to food served
+        struct histogram customer_wait; // arrival to food, as printed
+        long long rejected[REJECT_REASONS];
+        long long steals;
+        long long cook_wakeups; // COOK_SEM wake-ups, and those that found
+        long long cook_spurious;    // nothing to do
+        long long waiter_wakeups;
+        long long waiter_spurious;
+        long long cook_hires;   // by the supervisors
+        long long waiter_hires;
+        long long cook_minutes_paid;    // cooks on duty, summed over the day
+        long long waiter_minutes_paid;
+        long long batches;
+        long long cook_minutes; // time cooks spent cooking
+        int last_done;          // when the last order was prepared
+    } stats CACHE_ALIGNED;
+
+    struct {                    // guarded by DISPATCH_LOCK
+        int head;
+        int tail;
+    } dispatch CACHE_ALIGNED;
+};
+
+// One per waiter, guarded by WAITER_QUEUE_LOCK(i). Two queues of events:
+// food ready to serve (slot numbers, from the cooks) and customers waiting
+// to order. The food ring holds one entry per table, which is as many as
+// can be outstanding, so it never fills.
+struct waiter_area {
+    unsigned int seq;
+    int food_head;          // free-running ring counters, entry = counter % tables
+    int food_tail;
+    int po;                 // customers waiting to order
+    int head;               // free-running ring counters, slot = counter % cap
+    int tail;
+    int cap;
+    int busy;               // working on an item; written by the waiter alone
+                            // and read without the lock by waiter_pick()
+    int incoming;           // customers given this waiter, not yet queued;
+                            // atomic, a waiter sent home waits for them
+    int retire;             // sent home by the supervisor once its work is done:
+                            // 1 with its wake-up pending, 2 once seen
+    int steal_hint;         // 1: woken to look for customers to steal, not yet
+                            // seen; see waiter_hint()
+    int longest_wait;       // longest a customer taken from this queue waited
+                            // to order since the supervisor last looked
+    struct waiting_customer queue[];    // followed by int food[tables]
+} CACHE_ALIGNED;
+
+#define WAITER_FOOD(area) ((int *)((area)->queue + (area)->cap))
+
+#define SHM_AT(shm, offset, type) ((type *)((char *)(shm) + (offset)))
+#define WAITER_AREA(shm, i) SHM_AT(shm, (shm)->waiter_areas + (i) * (shm)->waiter_area_size, struct waiter_area)
+#define COOK_SLOTS(shm) SHM_AT(shm, (shm)->cook_slots, struct cook_order)
+#define WAITER_FINISH(shm) SHM_AT(shm, (shm)->waiter_finish, double)
+// Customer wake-up slots: one per table, leased when a customer is seated
+// and returned when they leave. SLOT_FREE is a stack of unused slot
+// numbers, SLOT_OWNER holds the customer id sitting in each slot.
+// Guarded by TABLE_LOCK. SLOT_WAITER is the waiter that took the order,
+// which is not the assigned one if it was stolen; the waiter writes it
+// before waking the customer. SLOT_COOKED is when a cook took the order,
+// written by the cook before the food is handed on.
+#define SLOT_FREE(shm) SHM_AT(shm, (shm)->slot_free, int)
+#define SLOT_OWNER(shm) SHM_AT(shm, (shm)->slot_owner, int)
+#define SLOT_WAITER(shm) SHM_AT(shm, (shm)->slot_waiter, int)
+#define SLOT_COOKED(shm) SHM_AT(shm, (shm)->slot_cooked, int)
+#define COOK_STATS(shm, i) (SHM_AT(shm, (shm)->cook_stats, struct cook_stats) + (i))
+#define WAITER_STATS(shm, i) (SHM_AT(shm, (shm)->waiter_stats, struct waiter_stats) + (i))
+// Minutes spent with n tables in use, n = 0..tables
+#define OCCUPANCY(shm) SHM_AT(shm, (shm)->occupancy, long long)
+// Dispatch queue: customer records handed by the customer main process to
+// its pool of worker processes (customer -p).
+#define DISPATCH_CAPACITY 64
+#define DISPATCH_SLOTS(shm) SHM_AT(shm, (shm)->dispatch_slots, struct customer_record)
+#define LOG_AREA(shm) SHM_AT(shm, (shm)->log_area, void)
+#define SYNC_AREA(shm) SHM_AT(shm, (shm)->sync_area, void)
+
+// Semaphore indices. COOK_SEM and WAITER_SEM(i) count events, not
+// wake-up calls: each is signalled once per item added to the queues it
+// stands for, while that queue's lock is held, and taken once per item
+// removed. So a cook or waiter is only ever woken with work waiting:
+//   COOK_SEM       orders in the cook queue, plus cooks sent home
+//   WAITER_SEM(i)  food ready and customers queued for waiter i, plus its
+//                  send-home and steal hint; a waiter stealing a customer
+//                  takes one too
+#define MUTEX 0
+#define COOK_SEM 1
+#define DISPATCH_ITEMS 5        // records in the dispatch queue
+#define DISPATCH_SPACE 6        // free entries in the dispatch queue
+#define CUSTOMER_DONE 7         // customers and pool workers that have finished
+#define OPENED(i) (8 + (i))     // signalled once when customer opens, for the
+                                // cook (i = 0) and waiter (1) supervisors
+#define FIXED_SEMS 10
+#define WAITER_SEM(i) (FIXED_SEMS + (i))
+#define CUSTOMER_SEM(slot) (FIXED_SEMS + 2 * config.max_waiters + (slot))
+#define NUM_SEMS (FIXED_SEMS + 2 * config.max_waiters + config.tables)
+
+// Fine-grained locks, taken in this order if ever nested:
+//   TABLE_LOCK -> WAITER_QUEUE_LOCK(i), ascending i -> COOK_QUEUE_LOCK -> MUTEX
+// The clock is atomic and the trace goes through the log rings, so the
+// restaurant itself no longer takes MUTEX. No path holds two locks at once,
+// so the SINGLE_MUTEX build can map them all back onto MUTEX for comparison.
+#ifndef SINGLE_MUTEX
+#define TABLE_LOCK 2                    // tables, wake-up slots
+#define COOK_QUEUE_LOCK 3               // cook queue
+#define DISPATCH_LOCK 4                 // dispatch queue
+#define WAITER_QUEUE_LOCK(i) (FIXED_SEMS + config.max_waiters + (i))  // waiter area i
+#else
+#define TABLE_LOCK MUTEX
+#define COOK_QUEUE_LOCK MUTEX
+#define DISPATCH_LOCK MUTEX
+#define WAITER_QUEUE_LOCK(i) MUTEX
+#endif
+
+// Seqcounts, see struct restaurant_shm. A reader copies the group between
+// seq_read_begin() and seq_read_retry() and tries again while the latter
+// returns 1; seq_read_begin() waits for a writer in its section first.
+void seq_write_begin(unsigned int *seq);
+void seq_write_end(unsigned int *seq);
+unsigned int seq_read_begin(const unsigned int *seq);
+int seq_read_retry(const unsigned int *seq, unsigned int start);
+
+// Name of a semaphore index, for sync_profile_report()
+void sem_name(int sem_num, char *buf, size_t len);
+// Semaphores listed in the lock profile
+#define PROFILE_TOP 10
+
+// Set up the defaults, then apply a config file and command line options.
+// Exits with a usage message on bad input.
+void config_parse(int argc, char *argv[]);
+// Its getopt() options
+#define CONFIG_OPTIONS "vaf:c:w:t:q:Q:s:P:b:B:k:K:A:SC:W:"
+
+// Bytes needed for the segment with the current configuration
+size_t shm_size(void);
+// Lay out a newly created segment of shm_size() bytes for the current
+// configuration and set up empty tables and queues. The semaphores are
+// created separately, in SYNC_AREA(shm).
+void shm_init(struct restaurant_shm *shm);
+// Check that an attached segment of `size` bytes was laid out by this
+// version of the programs, then load its configuration. Returns -1 if not.
+int shm_validate(struct restaurant_shm *shm, size_t size);
+
+const char *policy_name(int policy);
+const char *assign_name(int assign);
+
+// Names as they appear in the trace: cooks C, D, E, ... and waiters U..Z,
+// with numbered names once the letters run out
+const char *cook_name(int cook_id);
+const char *waiter_name(int waiter_id);
+const char *cook_indent(int cook_id);
+const char *waiter_indent(int waiter_id);
+
+// Function to display current time
+void print_time(int minutes);
+void fprint_time(FILE *fp, int minutes);
+
+// The simulated clock, in minutes after 11:00am. It only moves forward:
+// clock_advance() raises it to `time` with a compare-and-swap unless it is
+// already later, and returns the clock after that. Neither takes a lock.
+int clock_now(struct restaurant_shm *shm);
+int clock_advance(struct restaurant_shm *shm, int time);
+
+// Minutes a cook takes for one pass over `persons` persons. With the default
+// model (no setup, 5 per person) a single order takes 5 * count as before,
+// and batching saves nothing but wake-ups; a setup cost is what a batch
+// shares out.
+int cooking_time(int persons);
+
+// Queue operations. The caller holds the lock that guards the queue.
+// Pushes return -1 when the queue is full, pops when it is empty.
+// The cook queue is a ring for POLICY_FIFO and a binary heap ordered by
+// (key, seq) for the others; see cook_queue_push() for the keys.
+int cook_queue_push(struct restaurant_shm *shm, const struct cook_order *order);
+int cook_queue_pop(struct restaurant_shm *shm, struct cook_order *order);
+// The order cook_queue_pop() would return next, left in the queue
+int cook_queue_peek(struct restaurant_shm *shm, struct cook_order *order);
+int waiter_queue_push(struct waiter_area *area, const struct waiting_customer *customer);
+int waiter_queue_pop(struct waiter_area *area, struct waiting_customer *customer);
+// The customer waiter_queue_pop() would return next, left in the queue
+int waiter_queue_peek(struct waiter_area *area, struct waiting_customer *customer);
+void food_push(struct waiter_area *area, int slot);
+int food_pop(struct waiter_area *area, int *slot);
+int food_ready(struct waiter_area *area);
+// The dispatch queue has one producer. Its space and items are counted by
+// the DISPATCH_SPACE and DISPATCH_ITEMS semaphores, so it never overflows.
+void dispatch_push(struct restaurant_shm *shm, const struct customer_record *record);
+void dispatch_pop(struct restaurant_shm *shm, struct customer_record *record);
+
+// Wake-up slots. The caller holds TABLE_LOCK. A slot is leased together
+// with a table, so slot_lease() only fails if no table is free either.
+int slot_lease(struct restaurant_shm *shm, int customer_id);
+void slot_release(struct restaurant_shm *shm, int slot);
+
+// Choose the waiter for an arriving customer, by config.assign. The caller
+// holds TABLE_LOCK, which guards the round robin position; the waiters'
+// loads are read without their locks, so a choice may be slightly stale.
+// Only active waiters are picked. The chosen waiter counts the customer as
+// incoming, and is not sent home, until the caller has tried to queue the
+// customer and called waiter_arrived().
+int waiter_pick(struct restaurant_shm *shm, int customer_id);
+void waiter_arrived(struct restaurant_shm *shm, int waiter_id);
+// Work stealing: a waiter blocked on its wake-up never looks for customers
+// queued for others, so once `busy_waiter` has STEAL_MIN or more queued,
+// the customer that queued last gives an idle waiter a steal hint. The
+// hint is an item on that waiter's wake-up (see the semaphores below),
+// with at most one pending per waiter. Returns the idle waiter to hint,
+// -1 if none, after a check without locks; the caller takes the waiter's
+// WAITER_QUEUE_LOCK and gives the hint if waiter_idle() still holds.
+int waiter_hint(struct restaurant_shm *shm, int busy_waiter);
+// Nothing queued for the waiter, nothing in hand and no hint pending;
+// the caller holds its WAITER_QUEUE_LOCK
+int waiter_idle(struct waiter_area *area);
+
+// Statistics for comparing policies and batching: latency histograms,
+// what each cook and waiter did, and why customers were turned away.
+// Lock-free, called by any process, except stats_tables().
+void hist_add(struct histogram *h, int value);
+// Smallest bucket bound (or the maximum, if lower) that at least
+// `fraction` of the values fall under
+int hist_percentile(const struct histogram *h, double fraction);
+void stats_order_taken(struct restaurant_shm *shm, int wait);
+void stats_batch_done(struct restaurant_shm *shm, int cook_id, int orders, int minutes, int done_time);
+void stats_order_placed(struct restaurant_shm *shm, int wait);
+void stats_waiter_placed(struct restaurant_shm *shm, int waiter_id);
+void stats_waiter_served(struct restaurant_shm *shm, int waiter_id);
+void stats_customer_stolen(struct restaurant_shm *shm, int waiter_id);
+void stats_rejected(struct restaurant_shm *shm, int reason);
+// Account the time since the last change at the current occupancy. The
+// caller holds TABLE_LOCK and calls it just before changing tables.empty.
+void stats_tables(struct restaurant_shm *shm);
+// A cook (waiter) woke from COOK_SEM (WAITER_SEM); spurious: found no work
+void stats_cook_wakeup(struct restaurant_shm *shm, int spurious);
+void stats_waiter_wakeup(struct restaurant_shm *shm, int spurious);
+void stats_pool(struct restaurant_shm *shm, int cook_hires, int waiter_hires,
+                int cook_minutes, int waiter_minutes);
+// wait: arrival to food; cooking: a cook taking the order to food
+void stats_customer_served(struct restaurant_shm *shm, int wait, int cooking);
+// The end of day report, also printed on demand by the stats tool
+void stats_report(struct restaurant_shm *shm, int semid, FILE *fp);
+// The same figures as one line of JSON, for the benchmark (make bench):
+// wall time of the day, served customers per second of it, semaphore
+// system calls (see sync_syscalls_total()) and each latency histogram
+void stats_json(struct restaurant_shm *shm, int semid, double wall_seconds, FILE *fp);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "sync.h"
+#include "restaurant.h"
+
+// Print the statistics of the running restaurant: the same report that
+// customer prints at the end of the day, with the latency percentiles,
+// rejections, table occupancy and what each cook and waiter has done, and
+// in the profiling build the most contended semaphores so far.
+//   stats         once
+//   stats -i N    every N seconds until the day is over
+// It only reads the segment, so it can be run at any time and as often
+// as wanted without disturbing the run.
+int main(int argc, char *argv[]) {
+    int interval = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        if (opt == 'i' && atoi(optarg) > 0) {
+            interval = atoi(optarg);
+        } else {
+            fprintf(stderr, "Usage: %s [-i seconds]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    // Create a key for shared memory and semaphores (same as cook.c)
+    key_t key = ftok("./cook", 'R');
+    if (key == -1) {
+        perror("ftok");
+        exit(1);
+    }
+
+    // Get the shared memory segment
+    int shmid = shmget(key, 0, 0666);
+    if (shmid == -1) {
+        perror("shmget");
+        exit(1);
+    }
+
+    struct restaurant_shm *shm = shmat(shmid, NULL, SHM_RDONLY);
+    if (shm == (void *)-1) {
+        perror("shmat");
+        exit(1);
+    }
+
+    // Check that cook laid the segment out the way this build expects, and
+    // load the configuration from it
+    struct shmid_ds seg;
+    if (shmctl(shmid, IPC_STAT, &seg) == -1) {
+        perror("shmctl");
+        exit(1);
+    }
+    if (shm_validate(shm, seg.shm_segsz) == -1) {
+        fprintf(stderr, "%s: shared memory layout does not match, rebuild and restart cook\n", argv[0]);
+        exit(1);
+    }
+
+    // For the timing line; only read
+    int semid = sync_open(key, SYNC_AREA(shm), NUM_SEMS);
+    if (semid == -1) {
+        perror("sync_open");
+        exit(1);
+    }
+
+    while (1) {
+        print_time(clock_now(shm));
+        printf("\n");
+        stats_report(shm, semid, stdout);
+        sync_profile_report(semid, stdout, PROFILE_TOP, sem_name);
+        fflush(stdout);
+        if (interval == 0) break;
+        sleep(interval);
+        // customer removes the segment once the last customer has left
+        if (shmctl(shmid, IPC_STAT, &seg) == -1 || (seg.shm_perm.mode & SHM_DEST)) break;
+        printf("\n");
+    }
+
+    shmdt(shm);
+    return 0;
+}
@@ -0,0 +1,984 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+
+#include "sync.h"
+
+// A wake-up queued by sync_sleep() in virtual time
+struct sync_event {
+    int time;
+    int seq;                // events due at the same time fire in FIFO order
+    int actor;              // the sleeper
+};
+
+// An actor process in virtual time, from sync_actor_add() until
+// sync_actor_done(); it waits for its turn on its own hidden semaphore
+struct sync_actor {
+    int state;              // ACTOR_*
+    int next;               // next in the ready queue or a semaphore's queue
+    int order;              // sync_actor_add() calls before this one
+};
+
+#define ACTOR_FREE 0
+#define ACTOR_READY 1       // in the ready queue
+#define ACTOR_RUNNING 2     // its turn
+#define ACTOR_WAITING 3     // queued on a semaphore
+#define ACTOR_SLEEPING 4    // its wake-up is queued
+
+// Shared state at the start of the area, for both backends
+struct sync_header {
+    int removed;            // set by sync_remove()
+    int nsems;              // semaphores visible to the programs
+    int virtual_time;
+    // Virtual time scheduler, all guarded by the SCHED_LOCK semaphore
+    int closing;            // sync_remove() is sending the actors home
+    int running;            // actor whose turn it is, -1 if none
+    int ready_head;         // actors whose turn comes next, in FIFO order,
+    int ready_tail;         // -1 if none
+    int now;                // time of the last wake-up that fired
+    int seq;
+    int nevents;
+    int nfree;
+    int added;              // sync_actor_add() calls
+    long long clock;        // offset of the clock from the header, 0 if not
+                            // set, see sync_set_clock()
+    // Real time schedule, see sync_set_epoch()
+    int epoch_set;
+    int absolute;
+    useconds_t unit;
+    struct timespec epoch;
+    // Lateness of real time sleeps against the schedule, in microseconds,
+    // updated with atomic adds
+    long long sleeps;
+    long long late_sum;
+    long long late_squares;
+    long long late_max;
+    long long early_max;
+    long long syscalls;     // by every process, see sync_syscalls_total()
+    struct sync_event events[SYNC_MAX_ACTORS];     // min-heap on (time, seq)
+    struct sync_actor actors[SYNC_MAX_ACTORS];
+    int free_actors[SYNC_MAX_ACTORS];
+    // followed by int vals[nsems], int head[nsems] and int tail[nsems]: the
+    // virtual semaphore counts and the FIFO of actors waiting on each. The
+    // real semaphores are then only used to hand out turns.
+};
+
+// Hidden semaphores after the visible ones
+#define SCHED_LOCK(h) ((h)->nsems)
+#define CLOSED(h) ((h)->nsems + 1)      // the last actor has been sent home
+#define PARK(h, i) ((h)->nsems + 2 + (i))
+#define TOTAL_SEMS(nsems) ((nsems) + 2 + SYNC_MAX_ACTORS)
+
+#define ALIGN64(n) (((n) + 63) & ~(size_t)63)
+
+static size_t header_size(int nsems) {
+    return ALIGN64(sizeof(struct sync_header) + 3 * nsems * sizeof(int));
+}
+
+#ifdef SYNC_PROFILE
+// Per visible semaphore, after the header; updated with atomic adds by
+// every process, so the totals are there for whoever reports them
+struct sync_profile {
+    long long acquires;         // sync_wait() and successful sync_trywait()
+    long long contended;        // sync_wait() calls that had to block
+    long long wait_ns;          // time spent in sync_wait()
+    long long wait_max_ns;
+    long long holds;            // acquires released by the same process
+    long long hold_ns;          // from acquire to that release
+    long long hold_max_ns;
+};
+#define PROFILE_SIZE(nsems) ALIGN64((nsems) * sizeof(struct sync_profile))
+#else
+#define PROFILE_SIZE(nsems) 0
+#endif
+
+static int *vals(struct sync_header *h) {
+    return (int *)(h + 1);
+}
+
+static int *heads(struct sync_header *h) {
+    return (int *)(h + 1) + h->nsems;
+}
+
+static int *tails(struct sync_header *h) {
+    return (int *)(h + 1) + 2 * h->nsems;
+}
+
+#define MAX_SETS 4
+
+// Sets opened by this process, indexed by the returned semid
+static struct sync_set {
+    struct sync_header *h;
+    int sysv_id;
+#ifdef SYNC_PROFILE
+    long long *held;            // when this process acquired each semaphore, 0 if not
+#endif
+} sets[MAX_SETS];
+
+// Semaphores posted by one raw_signal_many() call; longer lists are split
+#define MAX_OPS 32
+
+static unsigned long syscalls;     // see sync_syscalls()
+
+// This process as a virtual time actor, see sync_actor_begin()
+static int self = -1;
+static int self_semid;
+static pid_t self_pid;
+
+// n system calls made for the semaphores, by this process and in total
+static void count_syscalls(struct sync_set *s, int n) {
+    syscalls += n;
+    __atomic_add_fetch(&s->h->syscalls, n, __ATOMIC_RELAXED);
+}
+
+#ifdef SYNC_SYSV
+
+// SysV backend: one semop() system call per operation
+
+union semun {
+    int val;
+    struct semid_ds *buf;
+    unsigned short *array;
+};
+
+static size_t backend_size(int nsems) {
+    return 0;
+}
+
+static int backend_init(struct sync_set *s, key_t key, int create) {
+    int nsems = TOTAL_SEMS(s->h->nsems);
+    s->sysv_id = semget(key, nsems, create ? (IPC_CREAT | 0666) : 0666);
+    if (s->sysv_id == -1 && create && errno == EINVAL) {
+        // A set of another size left over from an earlier run
+        semctl(semget(key, 0, 0666), 0, IPC_RMID);
+        s->sysv_id = semget(key, nsems, IPC_CREAT | 0666);
+    }
+    return s->sysv_id == -1 ? -1 : 0;
+}
+
+static int raw_setval(struct sync_set *s, int sem_num, int val) {
+    union semun arg;
+    arg.val = val;
+    count_syscalls(s, 1);
+    return semctl(s->sysv_id, sem_num, SETVAL, arg);
+}
+
+static int raw_wait(struct sync_set *s, int sem_num) {
+    struct sembuf sb = {sem_num, -1, 0};
+    count_syscalls(s, 1);
+    return semop(s->sysv_id, &sb, 1);
+}
+
+static int raw_trywait(struct sync_set *s, int sem_num) {
+    struct sembuf sb = {sem_num, -1, IPC_NOWAIT};
+    count_syscalls(s, 1);
+    return semop(s->sysv_id, &sb, 1);
+}
+
+static int raw_signal(struct sync_set *s, int sem_num) {
+    struct sembuf sb = {sem_num, 1, 0};
+    count_syscalls(s, 1);
+    return semop(s->sysv_id, &sb, 1);
+}
+
+// All n (at most MAX_OPS) in one semop(), which applies them atomically
+static int raw_signal_many(struct sync_set *s, const int *sem_nums, int n) {
+    struct sembuf sb[MAX_OPS];
+    for (int i = 0; i < n; i++) {
+        sb[i].sem_num = sem_nums[i];
+        sb[i].sem_op = 1;
+        sb[i].sem_flg = 0;
+    }
+    count_syscalls(s, 1);
+    return semop(s->sysv_id, sb, n);
+}
+
+static int raw_remove(struct sync_set *s) {
+    count_syscalls(s, 1);
+    return semctl(s->sysv_id, 0, IPC_RMID);
+}
+
+#else
+
+// Futex backend: process-shared POSIX semaphores in the shared segment.
+// sem_wait()/sem_post() only enter the kernel when a process has to
+// sleep or has to be woken.
+
+#include <semaphore.h>
+
+static size_t backend_size(int nsems) {
+    return TOTAL_SEMS(nsems) * sizeof(sem_t);
+}
+
+static sem_t *sems(struct sync_set *s) {
+    return (sem_t *)((char *)s->h + header_size(s->h->nsems) + PROFILE_SIZE(s->h->nsems));
+}
+
+static int backend_init(struct sync_set *s, key_t key, int create) {
+    if (create) {
+        for (int i = 0; i < TOTAL_SEMS(s->h->nsems); i++) {
+            if (sem_init(&sems(s)[i], 1, 0) == -1) return -1;
+        }
+    }
+    return 0;
+}
+
+static int raw_setval(struct sync_set *s, int sem_num, int val) {
+    sem_destroy(&sems(s)[sem_num]);
+    return sem_init(&sems(s)[sem_num], 1, val);
+}
+
+static int raw_wait(struct sync_set *s, int sem_num) {
+    if (sem_trywait(&sems(s)[sem_num]) == -1) {
+        // Has to sleep: a futex wait, and the futex wake that ends it
+        count_syscalls(s, 2);
+        while (sem_wait(&sems(s)[sem_num]) == -1) {
+            if (errno != EINTR) return -1;
+        }
+    }
+    if (__atomic_load_n(&s->h->removed, __ATOMIC_ACQUIRE)) {
+        // Woken by sync_remove(): pass the wake-up on to the next sleeper
+        sem_post(&sems(s)[sem_num]);
+        errno = EIDRM;
+        return -1;
+    }
+    return 0;
+}
+
+static int raw_trywait(struct sync_set *s, int sem_num) {
+    if (__atomic_load_n(&s->h->removed, __ATOMIC_ACQUIRE)) {
+        errno = EIDRM;
+        return -1;
+    }
+    while (sem_trywait(&sems(s)[sem_num]) == -1) {
+        if (errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+static int raw_signal(struct sync_set *s, int sem_num) {
+    return sem_post(&sems(s)[sem_num]);
+}
+
+// One after the other; a post only enters the kernel to wake a sleeper
+static int raw_signal_many(struct sync_set *s, const int *sem_nums, int n) {
+    for (int i = 0; i < n; i++) {
+        if (sem_post(&sems(s)[sem_nums[i]]) == -1) return -1;
+    }
+    return 0;
+}
+
+static int raw_remove(struct sync_set *s) {
+    for (int i = 0; i < TOTAL_SEMS(s->h->nsems); i++) {
+        sem_post(&sems(s)[i]);
+    }
+    return 0;
+}
+
+#endif
+
+size_t sync_area_size(int nsems) {
+    return header_size(nsems) + PROFILE_SIZE(nsems) + backend_size(nsems);
+}
+
+static int add_set(struct sync_header *h, key_t key, int create) {
+    for (int i = 0; i < MAX_SETS; i++) {
+        if (sets[i].h == NULL || sets[i].h == h) {
+            sets[i].h = h;
+            if (backend_init(&sets[i], key, create) == -1) {
+                sets[i].h = NULL;
+                return -1;
+            }
+            return i;
+        }
+    }
+    errno = ENOSPC;
+    return -1;
+}
+
+static struct sync_set *get_set(int semid, int sem_num) {
+    if (semid < 0 || semid >= MAX_SETS || sets[semid].h == NULL) {
+        errno = EINVAL;
+        return NULL;
+    }
+    struct sync_set *s = &sets[semid];
+    if (sem_num < 0 || sem_num >= s->h->nsems) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (__atomic_load_n(&s->h->removed, __ATOMIC_ACQUIRE)) {
+        errno = EIDRM;
+        return NULL;
+    }
+    return s;
+}
+
+int sync_create(key_t key, void *area, int nsems) {
+    struct sync_header *h = area;
+    h->removed = 0;
+    h->nsems = nsems;
+    h->virtual_time = 0;
+    h->closing = 0;
+    h->running = -1;
+    h->ready_head = -1;
+    h->ready_tail = -1;
+    h->now = 0;
+    h->seq = 0;
+    h->nevents = 0;
+    h->nfree = SYNC_MAX_ACTORS;
+    h->added = 0;
+    h->clock = 0;
+    h->epoch_set = 0;
+    h->syscalls = 0;
+    for (int i = 0; i < SYNC_MAX_ACTORS; i++) {
+        h->actors[i].state = ACTOR_FREE;
+        // Handed out lowest first
+        h->free_actors[i] = SYNC_MAX_ACTORS - 1 - i;
+    }
+    for (int i = 0; i < nsems; i++) {
+        vals(h)[i] = 0;
+        heads(h)[i] = -1;
+        tails(h)[i] = -1;
+    }
+    memset((char *)h + header_size(nsems), 0, PROFILE_SIZE(nsems));
+    int semid = add_set(h, key, 1);
+    if (semid == -1) return -1;
+    if (raw_setval(&sets[semid], SCHED_LOCK(h), 1) == -1) return -1;
+    return semid;
+}
+
+int sync_open(key_t key, void *area, int nsems) {
+    struct sync_header *h = area;
+    if (h->nsems < nsems) {
+        errno = ENOENT;     // not created yet, or created for fewer semaphores
+        return -1;
+    }
+    return add_set(h, key, 0);
+}
+
+int sync_set_virtual(int semid) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    s->h->virtual_time = 1;
+    return 0;
+}
+
+int sync_is_virtual(int semid) {
+    struct sync_set *s = get_set(semid, 0);
+    return s != NULL && s->h->virtual_time;
+}
+
+int sync_set_clock(int semid, int *clock) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    s->h->clock = (char *)clock - (char *)s->h;
+    return 0;
+}
+
+// Virtual time scheduler. One actor runs at a time: it keeps its turn
+// through signals and through waits that need not block, and only passes
+// it on when it blocks, sleeps or is done. An actor woken by a signal
+// joins the back of the ready queue rather than running alongside the
+// signaller. When nobody is ready the earliest sleeper wakes, and the
+// scheduler moves the clock to its time. So every run of the same day
+// makes the same moves in the same order.
+
+static int sched_lock(struct sync_set *s) {
+    return raw_wait(s, SCHED_LOCK(s->h));
+}
+
+static void sched_unlock(struct sync_set *s) {
+    raw_signal(s, SCHED_LOCK(s->h));
+}
+
+// SCHED_LOCK, unless sync_remove() has started sending the actors home
+static int sched_enter(struct sync_set *s) {
+    if (sched_lock(s) == -1) return -1;
+    if (s->h->closing) {
+        sched_unlock(s);
+        errno = EIDRM;
+        return -1;
+    }
+    return 0;
+}
+
+static int event_before(struct sync_event *a, struct sync_event *b) {
+    return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void event_push(struct sync_header *h, struct sync_event ev) {
+    int i = h->nevents++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!event_before(&ev, &h->events[parent])) break;
+        h->events[i] = h->events[parent];
+        i = parent;
+    }
+    h->events[i] = ev;
+}
+
+static struct sync_event event_pop(struct sync_header *h) {
+    struct sync_event top = h->events[0];
+    struct sync_event last = h->events[--h->nevents];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= h->nevents) break;
+        if (child + 1 < h->nevents && event_before(&h->events[child + 1], &h->events[child])) child++;
+        if (!event_before(&h->events[child], &last)) break;
+        h->events[i] = h->events[child];
+        i = child;
+    }
+    h->events[i] = last;
+    return top;
+}
+
+// Append to the FIFO that starts at *head, linked through actors[].next
+static void fifo_push(struct sync_header *h, int *head, int *tail, int actor) {
+    h->actors[actor].next = -1;
+    if (*tail == -1) {
+        *head = actor;
+    } else {
+        h->actors[*tail].next = actor;
+    }
+    *tail = actor;
+}
+
+static int fifo_pop(struct sync_header *h, int *head, int *tail) {
+    int actor = *head;
+    if (actor != -1) {
+        *head = h->actors[actor].next;
+        if (*head == -1) *tail = -1;
+    }
+    return actor;
+}
+
+static void ready_push(struct sync_header *h, int actor) {
+    h->actors[actor].state = ACTOR_READY;
+    fifo_push(h, &h->ready_head, &h->ready_tail, actor);
+}
+
+// Caller holds SCHED_LOCK, and the actor whose turn it was has given it
+// up: hand it to the next ready actor, or else fire the earliest wake-up.
+// While closing, tell sync_remove() once nobody is left to send home.
+static void dispatch(struct sync_set *s) {
+    struct sync_header *h = s->h;
+    int next = fifo_pop(h, &h->ready_head, &h->ready_tail);
+    if (next == -1 && h->closing) {
+        h->running = -1;
+        raw_signal(s, CLOSED(h));
+        return;
+    }
+    if (next == -1 && h->nevents > 0) {
+        struct sync_event ev = event_pop(h);
+        if (ev.time > h->now) h->now = ev.time;
+        if (h->clock != 0) {
+            int *clock = (int *)((char *)h + h->clock);
+            if (ev.time > __atomic_load_n(clock, __ATOMIC_RELAXED)) {
+                __atomic_store_n(clock, ev.time, __ATOMIC_RELEASE);
+            }
+        }
+        next = ev.actor;
+    }
+    h->running = next;
+    if (next != -1) {
+        h->actors[next].state = ACTOR_RUNNING;
+        raw_signal(s, PARK(h, next));
+    }
+}
+
+// Wait for this actor's turn. -1 with EIDRM if sync_remove() gave it, to
+// send the actor home.
+static int park(struct sync_set *s) {
+    if (raw_wait(s, PARK(s->h, self)) == -1) return -1;
+    if (__atomic_load_n(&s->h->closing, __ATOMIC_ACQUIRE)) {
+        errno = EIDRM;
+        return -1;
+    }
+    return 0;
+}
+
+// Caller holds SCHED_LOCK. The first actor queued on the semaphore gets
+// the signal, and with it a place in the ready queue.
+static void virtual_signal(struct sync_header *h, int sem_num) {
+    int actor = fifo_pop(h, &heads(h)[sem_num], &tails(h)[sem_num]);
+    if (actor == -1) {
+        vals(h)[sem_num]++;
+    } else {
+        ready_push(h, actor);
+    }
+}
+
+// Caller holds SCHED_LOCK
+static void actor_free(struct sync_header *h, int actor) {
+    h->actors[actor].state = ACTOR_FREE;
+    h->free_actors[h->nfree++] = actor;
+    if (h->running == actor) h->running = -1;
+}
+
+int sync_remove(int semid) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    if (h->virtual_time) {
+        // Send the actors home one at a time, in the order they were added,
+        // so that what they do on the way out comes in the same order too.
+        // Each is given a turn in which its wait or sleep fails with EIDRM,
+        // and passes it on when done or when its process exits.
+        if (sched_lock(s) == -1) return -1;
+        h->closing = 1;
+        h->nevents = 0;
+        h->ready_head = -1;
+        h->ready_tail = -1;
+        if (self != -1) {
+            actor_free(h, self);
+            self = -1;
+        }
+        int *order = malloc(SYNC_MAX_ACTORS * sizeof(int));
+        if (order == NULL) {
+            sched_unlock(s);
+            return -1;
+        }
+        int n = 0;
+        for (int i = 0; i < SYNC_MAX_ACTORS; i++) {
+            int state = h->actors[i].state;
+            if (state == ACTOR_FREE || i == h->running) continue;
+            int k = n++;
+            while (k > 0 && h->actors[order[k - 1]].order > h->actors[i].order) {
+                order[k] = order[k - 1];
+                k--;
+            }
+            order[k] = i;
+        }
+        for (int k = 0; k < n; k++) ready_push(h, order[k]);
+        free(order);
+        // Someone still running passes its turn on when done
+        if (n > 0 && h->running == -1) dispatch(s);
+        int wait = (n > 0 || h->running != -1);
+        sched_unlock(s);
+        if (wait && raw_wait(s, CLOSED(h)) == -1) return -1;
+    }
+    __atomic_store_n(&h->removed, 1, __ATOMIC_RELEASE);
+    return raw_remove(s);
+}
+
+int sync_setval(int semid, int sem_num, int val) {
+    struct sync_set *s = get_set(semid, sem_num);
+    if (s == NULL) return -1;
+    if (s->h->virtual_time) {
+        vals(s->h)[sem_num] = val;
+        return raw_setval(s, sem_num, 0);
+    }
+    return raw_setval(s, sem_num, val);
+}
+
+static int wait_op(int semid, int sem_num) {
+    struct sync_set *s = get_set(semid, sem_num);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    if (!h->virtual_time) return raw_wait(s, sem_num);
+
+    if (sched_enter(s) == -1) return -1;
+    if (vals(h)[sem_num] > 0) {
+        vals(h)[sem_num]--;
+        sched_unlock(s);
+        return 0;
+    }
+    if (self == -1) {
+        // Only an actor has a turn to wait for
+        sched_unlock(s);
+        errno = EPERM;
+        return -1;
+    }
+    // The signaller hands its count over, see virtual_signal()
+    h->actors[self].state = ACTOR_WAITING;
+    fifo_push(h, &heads(h)[sem_num], &tails(h)[sem_num], self);
+    h->running = -1;
+    dispatch(s);
+    sched_unlock(s);
+    return park(s);
+}
+
+static int trywait_op(int semid, int sem_num) {
+    struct sync_set *s = get_set(semid, sem_num);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    if (!h->virtual_time) return raw_trywait(s, sem_num);
+
+    if (sched_enter(s) == -1) return -1;
+    int taken = (vals(h)[sem_num] > 0);
+    if (taken) vals(h)[sem_num]--;
+    sched_unlock(s);
+    if (!taken) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return 0;
+}
+
+static int signal_op(int semid, int sem_num) {
+    struct sync_set *s = get_set(semid, sem_num);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    if (!h->virtual_time) return raw_signal(s, sem_num);
+
+    if (sched_enter(s) == -1) return -1;
+    virtual_signal(h, sem_num);
+    sched_unlock(s);
+    return 0;
+}
+
+int sync_set_epoch(int semid, useconds_t usec_per_minute, int absolute) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    if (clock_gettime(CLOCK_MONOTONIC, &h->epoch) == -1) return -1;
+    h->unit = usec_per_minute;
+    h->absolute = absolute;
+    h->sleeps = 0;
+    h->late_sum = 0;
+    h->late_squares = 0;
+    h->late_max = 0;
+    h->early_max = 0;
+    __atomic_store_n(&h->epoch_set, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int sync_timing(int semid, struct sync_timing *timing) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    timing->absolute = h->absolute;
+    timing->sleeps = __atomic_load_n(&h->sleeps, __ATOMIC_RELAXED);
+    timing->late_mean = 0;
+    timing->late_stddev = 0;
+    if (timing->sleeps > 0) {
+        double mean = (double)h->late_sum / timing->sleeps;
+        double variance = (double)h->late_squares / timing->sleeps - mean * mean;
+        timing->late_mean = mean;
+        timing->late_stddev = variance > 0 ? sqrt(variance) : 0;
+    }
+    timing->late_max = h->late_max;
+    timing->early_max = h->early_max;
+    return 0;
+}
+
+static void atomic_max(long long *max, long long value) {
+    long long old = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > old &&
+           !__atomic_compare_exchange_n(max, &old, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // old now holds the current maximum, try again
+    }
+}
+
+// Real time sleep for sync_sleep(). Before the epoch is set there is no
+// schedule to keep to, only the relative delay.
+static int real_sleep(struct sync_header *h, int until, useconds_t usec) {
+    if (!__atomic_load_n(&h->epoch_set, __ATOMIC_ACQUIRE)) return usleep(usec);
+
+    long long offset = (long long)until * h->unit;
+    struct timespec deadline = h->epoch;
+    deadline.tv_sec += offset / 1000000 + (deadline.tv_nsec + offset % 1000000 * 1000) / 1000000000;
+    deadline.tv_nsec = (deadline.tv_nsec + offset % 1000000 * 1000) % 1000000000;
+    if (h->absolute) {
+        // Wakes at the deadline however late the sleep started, so delays
+        // do not add up; a deadline already past returns at once
+        int err;
+        while ((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL)) == EINTR);
+        if (err != 0) {
+            errno = err;
+            return -1;
+        }
+    } else if (usleep(usec) == -1) {
+        return -1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long late = (now.tv_sec - deadline.tv_sec) * 1000000LL + (now.tv_nsec - deadline.tv_nsec) / 1000;
+    __atomic_add_fetch(&h->sleeps, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->late_sum, late, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&h->late_squares, late * late, __ATOMIC_RELAXED);
+    atomic_max(&h->late_max, late);
+    atomic_max(&h->early_max, -late);
+    return 0;
+}
+
+static int signal_many_op(int semid, const int *sem_nums, int n) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    for (int i = 0; i < n; i++) {
+        if (sem_nums[i] < 0 || sem_nums[i] >= h->nsems) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    for (int done = 0; done < n; done += MAX_OPS) {
+        const int *chunk = sem_nums + done;
+        int len = (n - done < MAX_OPS) ? n - done : MAX_OPS;
+        if (!h->virtual_time) {
+            if (raw_signal_many(s, chunk, len) == -1) return -1;
+            continue;
+        }
+
+        // As sync_signal() for each; the woken join the ready queue in order
+        if (sched_enter(s) == -1) return -1;
+        for (int i = 0; i < len; i++) {
+            virtual_signal(h, chunk[i]);
+        }
+        sched_unlock(s);
+    }
+    return 0;
+}
+
+unsigned long sync_syscalls(void) {
+    return syscalls;
+}
+
+long long sync_syscalls_total(int semid) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    return __atomic_load_n(&s->h->syscalls, __ATOMIC_RELAXED);
+}
+
+int sync_sleep(int semid, int until, useconds_t usec) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    if (!h->virtual_time) return real_sleep(h, until, usec);
+
+    if (sched_enter(s) == -1) return -1;
+    if (self == -1) {
+        sched_unlock(s);
+        errno = EPERM;
+        return -1;
+    }
+    // An actor has at most one wake-up queued, so there is always room
+    struct sync_event ev = {until, h->seq++, self};
+    event_push(h, ev);
+    h->actors[self].state = ACTOR_SLEEPING;
+    h->running = -1;
+    dispatch(s);
+    sched_unlock(s);
+    return park(s);
+}
+
+// An actor whose process exits without sync_actor_done(), e.g. after its
+// last wait failed with EIDRM, still passes its turn on
+static void actor_exit(void) {
+    if (self != -1 && getpid() == self_pid) sync_actor_done(self_semid);
+}
+
+int sync_actor_add(int semid) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    struct sync_header *h = s->h;
+    if (!h->virtual_time) return 0;
+
+    if (sched_enter(s) == -1) return -1;
+    if (h->nfree == 0) {
+        sched_unlock(s);
+        errno = ENOSPC;
+        return -1;
+    }
+    int actor = h->free_actors[--h->nfree];
+    h->actors[actor].order = h->added++;
+    if (h->running == -1) {
+        // Nothing else is going on, its turn is now
+        h->running = actor;
+        h->actors[actor].state = ACTOR_RUNNING;
+        raw_signal(s, PARK(h, actor));
+    } else {
+        ready_push(h, actor);
+    }
+    sched_unlock(s);
+    return actor;
+}
+
+int sync_actor_begin(int semid, int actor) {
+    static int registered;
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    if (!s->h->virtual_time) return 0;
+    if (actor < 0 || actor >= SYNC_MAX_ACTORS) {
+        errno = EINVAL;
+        return -1;
+    }
+    self = actor;
+    self_semid = semid;
+    self_pid = getpid();
+    if (!registered && atexit(actor_exit) == 0) registered = 1;
+    return park(s);
+}
+
+void sync_actor_done(int semid) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL || !s->h->virtual_time || self == -1) return;
+    // Also while closing, to pass the turn on
+    if (sched_lock(s) == -1) return;
+    actor_free(s->h, self);
+    self = -1;
+    if (s->h->running == -1) dispatch(s);
+    sched_unlock(s);
+}
+
+#ifdef SYNC_PROFILE
+
+// Profiling build: every wait and signal on a visible semaphore is timed
+// with CLOCK_MONOTONIC. A wait first tries without blocking, so that
+// contended waits can be told apart (with SysV that costs one more
+// semop() for those). Hold time runs from an acquire to the next signal
+// of the same semaphore by the same process, which for the locks is the
+// critical section; the event semaphores are signalled by someone else
+// and so have no hold time.
+
+static long long now_ns(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static struct sync_profile *profile(struct sync_set *s, int sem_num) {
+    return (struct sync_profile *)((char *)s->h + header_size(s->h->nsems)) + sem_num;
+}
+
+static void acquired(int semid, int sem_num, long long start, int contended) {
+    struct sync_set *s = &sets[semid];
+    struct sync_profile *p = profile(s, sem_num);
+    long long now = now_ns();
+    __atomic_add_fetch(&p->acquires, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&p->contended, contended, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&p->wait_ns, now - start, __ATOMIC_RELAXED);
+    atomic_max(&p->wait_max_ns, now - start);
+    if (s->held == NULL) s->held = calloc(s->h->nsems, sizeof(long long));
+    if (s->held != NULL) s->held[sem_num] = now;
+}
+
+static void released(int semid, int sem_num) {
+    struct sync_set *s = &sets[semid];
+    if (s->held == NULL || s->held[sem_num] == 0) return;
+    struct sync_profile *p = profile(s, sem_num);
+    long long hold = now_ns() - s->held[sem_num];
+    s->held[sem_num] = 0;
+    __atomic_add_fetch(&p->holds, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&p->hold_ns, hold, __ATOMIC_RELAXED);
+    atomic_max(&p->hold_max_ns, hold);
+}
+
+int sync_wait(int semid, int sem_num) {
+    long long start = now_ns();
+    if (trywait_op(semid, sem_num) == 0) {
+        acquired(semid, sem_num, start, 0);
+        return 0;
+    }
+    if (errno != EAGAIN || wait_op(semid, sem_num) == -1) return -1;
+    acquired(semid, sem_num, start, 1);
+    return 0;
+}
+
+int sync_trywait(int semid, int sem_num) {
+    long long start = now_ns();
+    if (trywait_op(semid, sem_num) == -1) return -1;
+    acquired(semid, sem_num, start, 0);
+    return 0;
+}
+
+int sync_signal(int semid, int sem_num) {
+    if (get_set(semid, sem_num) == NULL) return -1;
+    released(semid, sem_num);
+    return signal_op(semid, sem_num);
+}
+
+int sync_signal_many(int semid, const int *sem_nums, int n) {
+    if (get_set(semid, 0) == NULL) return -1;
+    for (int i = 0; i < n; i++) {
+        if (sem_nums[i] >= 0 && sem_nums[i] < sets[semid].h->nsems) released(semid, sem_nums[i]);
+    }
+    return signal_many_op(semid, sem_nums, n);
+}
+
+static struct sync_profile *sort_profiles;     // for by_wait()
+
+static int by_wait(const void *a, const void *b) {
+    long long wa = sort_profiles[*(const int *)a].wait_ns;
+    long long wb = sort_profiles[*(const int *)b].wait_ns;
+    return (wa < wb) - (wa > wb);
+}
+
+int sync_profile_report(int semid, FILE *fp, int top, sync_name_fn name) {
+    struct sync_set *s = get_set(semid, 0);
+    if (s == NULL) return -1;
+    int nsems = s->h->nsems;
+    int *order = malloc(nsems * sizeof(int));
+    if (order == NULL) return -1;
+    int used = 0;
+    long long acquires = 0, contended = 0, wait_ns = 0, hold_ns = 0;
+    for (int i = 0; i < nsems; i++) {
+        struct sync_profile *p = profile(s, i);
+        if (p->acquires == 0) continue;
+        order[used++] = i;
+        acquires += p->acquires;
+        contended += p->contended;
+        wait_ns += p->wait_ns;
+        hold_ns += p->hold_ns;
+    }
+    sort_profiles = profile(s, 0);
+    qsort(order, used, sizeof(int), by_wait);
+
+    fprintf(fp, "semaphores: %lld acquires, %lld contended, %.1f ms waiting, %.1f ms held\n",
+            acquires, contended, wait_ns / 1e6, hold_ns / 1e6);
+    // Locks (released by the process that took them) first: time waiting
+    // on those is contention. On the others it is mostly waiting for work.
+    for (int locks = 1; locks >= 0; locks--) {
+        fprintf(fp, "  %-22s %9s %9s %9s %8s %8s %9s %8s %8s\n",
+                locks ? "locks" : "wake-ups", "acquires", "contended",
+                "wait ms", "mean us", "max us", "held ms", "mean us", "max us");
+        int shown = 0;
+        for (int k = 0; k < used && shown < top; k++) {
+            struct sync_profile *p = profile(s, order[k]);
+            if ((p->holds > 0) != locks) continue;
+            char label[32];
+            name(order[k], label, sizeof(label));
+            fprintf(fp, "  %-22s %9lld %9lld %9.1f %8.1f %8.1f %9.1f %8.1f %8.1f\n", label,
+                    p->acquires, p->contended, p->wait_ns / 1e6, p->wait_ns / 1e3 / p->acquires,
+                    p->wait_max_ns / 1e3, p->hold_ns / 1e6,
+                    p->holds ? p->hold_ns / 1e3 / p->holds : 0.0, p->hold_max_ns / 1e3);
+            shown++;
+        }
+    }
+    free(order);
+    return 0;
+}
+
+#else
+
+int sync_wait(int semid, int sem_num) {
+    return wait_op(semid, sem_num);
+}
+
+int sync_trywait(int semid, int sem_num) {
+    return trywait_op(semid, sem_num);
+}
+
+int sync_signal(int semid, int sem_num) {
+    return signal_op(semid, sem_num);
+}
+
+int sync_signal_many(int semid, const int *sem_nums, int n) {
+    return signal_many_op(semid, sem_nums, n);
+}
+
+int sync_profile_report(int semid, FILE *fp, int top, sync_name_fn name) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+// Process-shared semaphores used by cook, waiter and customer.
+//
+// The default backend keeps an array of process-shared POSIX semaphores
+// (futex based) inside the shared memory segment, so an uncontended
+// wait or signal is a single atomic operation with no system call.
+// Building with -DSYNC_SYSV switches back to one SysV semaphore set
+// driven through semop(), for comparison.
+//
+// Either way a semaphore set is named by the int returned from
+// sync_create()/sync_open() and each semaphore by its index, exactly
+// like a SysV semid. sync_remove() wakes every blocked process, and
+// any later sync_wait()/sync_signal() on the set fails with EIDRM,
+// which is how the cooks and waiters learn that the day is over.
+//
+// Virtual time: after sync_set_virtual() the set also runs a
+// discrete-event scheduler, and the actor processes take turns: only one
+// runs at a time. An actor keeps its turn until it blocks in sync_wait(),
+// sleeps or calls sync_actor_done(); one woken by a signal queues for its
+// turn behind those already woken. sync_sleep() does not sleep but queues
+// a wake-up at a simulated time, and when no actor is left to run the
+// earliest one fires at once and moves the clock (sync_set_clock()) to
+// its time. Runs of the same day are therefore identical, trace and all.
+// sync_remove() then sends the remaining actors home one at a time.
+// Only actors may block or sleep; others get EPERM.
+
+// Most actors at the same time, in virtual time
+#define SYNC_MAX_ACTORS 1024
+
+// Bytes the backend needs inside the shared segment for nsems semaphores.
+// The area must be 64-byte aligned.
+size_t sync_area_size(int nsems);
+
+// Create (cook) or open (waiter, customer) the semaphore set for key.
+// area points into the attached shared segment. Returns -1 on error.
+int sync_create(key_t key, void *area, int nsems);
+int sync_open(key_t key, void *area, int nsems);
+
+// Switch a freshly created set to virtual time, before any sync_setval()
+int sync_set_virtual(int semid);
+int sync_is_virtual(int semid);
+// The simulated clock, an int in the same shared segment as the set,
+// which the virtual time scheduler moves forward as wake-ups fire
+int sync_set_clock(int semid, int *clock);
+
+int sync_setval(int semid, int sem_num, int val);
+int sync_wait(int semid, int sem_num);
+// Take the semaphore only if that does not block; -1 with EAGAIN if not
+int sync_trywait(int semid, int sem_num);
+int sync_signal(int semid, int sem_num);
+// Signal each of sem_nums[0..n-1] once, in that order, e.g. a wake-up
+// followed by the unlock of the queue it was queued under. The SysV
+// backend does it in a single semop() call, which applies the whole
+// list atomically; the futex backend posts them one after the other.
+int sync_signal_many(int semid, const int *sem_nums, int n);
+int sync_remove(int semid);
+
+// Sleep for usec of real time, or in virtual time until simulated
+// minute 'until'. Returns -1 if the set was removed meanwhile.
+int sync_sleep(int semid, int until, useconds_t usec);
+
+// Real time: anchor simulated minute 0 at the current time, with
+// usec_per_minute of real time per minute. From then on every
+// sync_sleep() is measured against its deadline epoch + until minutes,
+// and with absolute set it sleeps until that deadline with
+// clock_nanosleep(TIMER_ABSTIME) instead of for usec, so fork latency
+// and scheduling delays do not add up into drift.
+int sync_set_epoch(int semid, useconds_t usec_per_minute, int absolute);
+
+// How late real time sleeps woke against their deadlines, in microseconds
+struct sync_timing {
+    int absolute;
+    long long sleeps;
+    double late_mean;       // negative: early on average
+    double late_stddev;     // jitter
+    long long late_max;
+    long long early_max;
+};
+int sync_timing(int semid, struct sync_timing *timing);
+
+// Actors in virtual time; no-ops in real time. A parent adds each actor
+// before it forks it, which gives the actor its place in the queue for
+// turns, and the child calls sync_actor_begin() with the returned id
+// before anything else, to wait for its first turn. A process can add
+// itself the same way. sync_actor_add() returns -1 on error, with ENOSPC
+// for more than SYNC_MAX_ACTORS actors. An actor that exits without
+// sync_actor_done() passes its turn on at exit().
+int sync_actor_add(int semid);
+int sync_actor_begin(int semid, int actor);
+void sync_actor_done(int semid);
+
+// System calls made for the semaphores by this process so far. With
+// SysV that is every semop()/semctl(). The futex backend only enters the
+// kernel inside sem_wait()/sem_post(), where it cannot be seen, so it
+// counts two for each wait that has to sleep, the futex wait and the
+// wake that ends it: an estimate that leaves out spurious futex calls.
+unsigned long sync_syscalls(void);
+// The same, added up over every process using the set
+long long sync_syscalls_total(int semid);
+
+// Lock profiling, in the build with -DSYNC_PROFILE (make profile): every
+// process adds the acquires, contended waits, wait time and hold time of
+// each semaphore to counters in the shared area. Prints the totals, then
+// the `top` locks and the `top` other semaphores with the most time
+// waited on them, named by `name`. Prints nothing in other builds.
+typedef void (*sync_name_fn)(int sem_num, char *buf, size_t len);
+int sync_profile_report(int semid, FILE *fp, int top, sync_name_fn name);
+
+#endif